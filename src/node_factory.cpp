@@ -0,0 +1,125 @@
+#include "./node_factory.h"
+
+#include <algorithm>
+#include <istream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+namespace {
+	auto is_space(char c) -> bool {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	// Splits line at whitespace into words, which is cleared first so that it can be reused across lines.
+	void split(std::string_view line, std::vector<std::string_view>& words) {
+		words.clear();
+		auto i = std::size_t{0};
+		while (true){
+			while (i < line.size() && is_space(line[i])){
+				++i;
+			}
+			if (i == line.size()){
+				return;
+			}
+			auto start = i;
+			while (i < line.size() && !is_space(line[i])){
+				++i;
+			}
+			words.push_back(line.substr(start, i - start));
+		}
+	}
+
+	[[noreturn]] void fail(std::size_t line, const std::string& what) {
+		throw std::runtime_error("config line " + std::to_string(line) + ": " + what);
+	}
+} // namespace
+
+auto ppl::node_factory::create(pipeline_builder& builder,
+                               std::string_view name,
+                               std::span<const std::string_view> words) const -> node_id {
+	auto found = this->factories_.find(std::string{name});
+	if (found == this->factories_.end()){
+		throw std::invalid_argument("no node type " + std::string{name});
+	}
+	return found->second(builder, words);
+}
+
+void ppl::load_pipeline(std::istream& config,
+                        const node_factory& factory,
+                        pipeline& target,
+                        std::pmr::memory_resource* resource) {
+	auto buffer = std::ostringstream{};
+	buffer << config.rdbuf();
+	auto text = std::move(buffer).str();
+	auto lines = std::vector<std::string_view>{};
+	for (auto start = std::size_t{0}; start <= text.size();){
+		auto end = std::min(text.find('\n', start), text.size());
+		lines.push_back(std::string_view{text}.substr(start, end - start));
+		start = end + 1;
+	}
+
+	// size everything from a first look at the lines, so that nothing grows while building
+	auto words = std::vector<std::string_view>{};
+	auto nodes = std::size_t{0};
+	auto edges = std::size_t{0};
+	for (auto line : lines){
+		split(line, words);
+		if (!words.empty()){
+			nodes += words.front() == "node";
+			edges += words.front() == "edge";
+		}
+	}
+	auto builder = pipeline_builder{resource};
+	builder.reserve(nodes, edges);
+	auto labels = std::unordered_map<std::string_view, pipeline::node_id>{};
+	labels.reserve(nodes);
+
+	auto node_of = [&labels](std::size_t number, std::string_view label) {
+		auto found = labels.find(label);
+		if (found == labels.end()){
+			fail(number, "no node labelled " + std::string{label});
+		}
+		return found->second;
+	};
+	for (auto i = 0u; i < lines.size(); ++i){
+		auto number = i + 1;
+		split(lines[i], words);
+		if (words.empty() || words.front().starts_with('#')){
+			continue;
+		}
+		if (words.front() == "node"){
+			if (words.size() < 3){
+				fail(number, "expected node <label> <type> <arguments>...");
+			}
+			if (labels.contains(words[1])){
+				fail(number, "node " + std::string{words[1]} + " is already defined");
+			}
+			try {
+				labels.emplace(words[1], factory.create(builder, words[2], std::span{words}.subspan(3)));
+			} catch (std::bad_alloc&) {
+				throw;
+			} catch (std::exception& e) {
+				// bad words, or anything else the node's constructor refused
+				fail(number, e.what());
+			}
+		}
+		else if (words.front() == "edge"){
+			auto slot = 0;
+			auto parsed = false;
+			if (words.size() == 4){
+				auto [end, error] = std::from_chars(words[3].data(), words[3].data() + words[3].size(), slot);
+				parsed = error == std::errc{} && end == words[3].data() + words[3].size();
+			}
+			if (!parsed){
+				fail(number, "expected edge <src label> <dst label> <slot>");
+			}
+			builder.connect(node_of(number, words[1]), node_of(number, words[2]), slot);
+		}
+		else {
+			fail(number, "unknown directive " + std::string{words.front()});
+		}
+	}
+
+	builder.commit(target);
+}
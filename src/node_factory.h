@@ -0,0 +1,131 @@
+#ifndef COMP6771_NODE_FACTORY_H
+#define COMP6771_NODE_FACTORY_H
+
+#include <charconv>
+#include <concepts>
+#include <functional>
+#include <iosfwd>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "./pipeline.h"
+
+namespace ppl {
+
+	namespace internal {
+		// Converts one word of a config line to a constructor argument of type T.
+		template<typename T>
+		auto parse_argument(std::string_view word) -> T {
+			static_assert(!std::is_same_v<T, std::string_view>,
+			              "node_factory::add(): the config text is gone once it is loaded, take std::string instead");
+			if constexpr (std::is_same_v<T, std::string>) {
+				return T{word};
+			}
+			else if constexpr (std::is_same_v<T, bool>) {
+				if (word == "true" || word == "false") {
+					return word == "true";
+				}
+				throw std::invalid_argument("expected true or false, not " + std::string{word});
+			}
+			else {
+				static_assert(std::is_arithmetic_v<T>, "node_factory::add() parses strings, bools and numbers only");
+				auto value = T{};
+				auto [end, error] = std::from_chars(word.data(), word.data() + word.size(), value);
+				if (error != std::errc{} || end != word.data() + word.size()) {
+					throw std::invalid_argument("expected a number, not " + std::string{word});
+				}
+				return value;
+			}
+		}
+
+		template<typename... Args, std::size_t... Is>
+		auto parse_arguments([[maybe_unused]] std::span<const std::string_view> words, std::index_sequence<Is...>)
+		   -> std::tuple<Args...> {
+			return std::tuple<Args...>{parse_argument<Args>(words[Is])...};
+		}
+	} // namespace internal
+
+	// Makes nodes by the name of their type, for pipelines described by text (see load_pipeline()).
+	//
+	//     auto factory = ppl::node_factory{};
+	//     factory.add<my_source, int>("source");              // "source 10" -> create_node<my_source>(10)
+	//     factory.add<my_sink>("sink", [&out](auto words) {   // any other parsing, or arguments from elsewhere
+	//         return std::tuple{&out};
+	//     });
+	class node_factory {
+	 public:
+		using node_id = pipeline::node_id;
+
+		// N is constructed from exactly sizeof...(Args) words, each parsed as the corresponding argument type:
+		// std::string, bool (true or false) or a number. Words are copied, as the config text does not outlive
+		// load_pipeline(), so there is no std::string_view argument.
+		template<typename N, typename... Args>
+		    requires concrete_node<N> && std::constructible_from<N, Args...>
+		void add(std::string name) {
+			this->add<N>(std::move(name), [](std::span<const std::string_view> words) {
+				if (words.size() != sizeof...(Args)) {
+					throw std::invalid_argument("expected " + std::to_string(sizeof...(Args)) + " arguments, not "
+					                            + std::to_string(words.size()));
+				}
+				return internal::parse_arguments<Args...>(words, std::index_sequence_for<Args...>{});
+			});
+		}
+
+		// parse turns the words following the name into a tuple of constructor arguments for N, throwing
+		// std::invalid_argument if it cannot. The words are only valid during the call.
+		template<typename N, typename Parse>
+		    requires concrete_node<N> && std::invocable<Parse&, std::span<const std::string_view>>
+		void add(std::string name, Parse parse) {
+			auto create = [parse = std::move(parse)](pipeline_builder& builder,
+			                                         std::span<const std::string_view> words) mutable {
+				return std::apply(
+				   [&builder](auto&&... args) {
+					   return builder.create_node<N>(std::forward<decltype(args)>(args)...);
+				   },
+				   parse(words));
+			};
+			if (!this->factories_.emplace(name, std::move(create)).second) {
+				throw std::invalid_argument("node_factory: " + name + " is already registered");
+			}
+		}
+
+		[[nodiscard]] auto contains(std::string_view name) const -> bool {
+			return this->factories_.contains(std::string{name});
+		}
+
+		// Creates a node of the type registered as name from the words that followed it.
+		// Throws std::invalid_argument if name is not registered or the words do not parse, and whatever N's
+		// constructor throws.
+		auto create(pipeline_builder& builder, std::string_view name, std::span<const std::string_view> words) const
+		   -> node_id;
+
+	 private:
+		std::unordered_map<std::string, std::function<node_id(pipeline_builder&, std::span<const std::string_view>)>>
+		   factories_{};
+	};
+
+	// Builds the pipeline described by config and replaces target's graph with it, as pipeline_builder::commit().
+	// Every line is empty, a # comment, or one of
+	//
+	//     node <label> <type> <arguments>...    create a node through factory; labels name nodes in edge lines
+	//     edge <src label> <dst label> <slot>   connect src to slot of dst
+	//
+	// with words separated by whitespace. The whole text is read first, so storage for every node and edge is
+	// reserved before the first is created. Throws std::runtime_error naming the line for a malformed line or a
+	// node that cannot be made, and as pipeline_builder::commit() for bad edges or an invalid graph; target is then
+	// left unchanged.
+	void load_pipeline(std::istream& config,
+	                   const node_factory& factory,
+	                   pipeline& target,
+	                   std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+} // namespace ppl
+
+#endif // COMP6771_NODE_FACTORY_H
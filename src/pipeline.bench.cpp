@@ -0,0 +1,266 @@
+// Benchmarks for the pipeline, built as pipeline_bench.
+// Results are reported as XML by default (including every benchmark's mean, standard deviation and outliers), so they
+// can be recorded and compared across releases:
+//
+//     ./pipeline_bench -o bench.xml            # everything
+//     ./pipeline_bench "[step]" -r console     # one group, human-readable
+//
+// Measure optimized builds; the default Debug build runs under sanitizers.
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#define CATCH_CONFIG_DEFAULT_REPORTER "xml"
+#include <catch2/catch.hpp>
+
+#include "./pipeline.h"
+
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+	// Never closes, so a graph can be stepped as often as the benchmark needs.
+	struct ticker : ppl::source<int> {
+		int current_value = 0;
+		auto name() const -> std::string override {
+			return "Ticker";
+		}
+		auto poll_next() -> ppl::poll override {
+			++current_value;
+			return ppl::poll::ready;
+		}
+		auto value() const -> const int& override {
+			return current_value;
+		}
+	};
+
+	struct increment : ppl::component<std::tuple<int>, int> {
+		const ppl::producer<int>* slot0 = nullptr;
+		int current_value = 0;
+		auto name() const -> std::string override {
+			return "Increment";
+		}
+		void connect(const ppl::node* src, int slot) override {
+			if (slot == 0) {
+				slot0 = static_cast<const ppl::producer<int>*>(src);
+			}
+		}
+		auto poll_next() -> ppl::poll override {
+			current_value = slot0->value() + 1;
+			return ppl::poll::ready;
+		}
+		auto value() const -> const int& override {
+			return current_value;
+		}
+	};
+
+	struct add : ppl::component<std::tuple<int, int>, int> {
+		const ppl::producer<int>* slot0 = nullptr;
+		const ppl::producer<int>* slot1 = nullptr;
+		int current_value = 0;
+		auto name() const -> std::string override {
+			return "Add";
+		}
+		void connect(const ppl::node* src, int slot) override {
+			(slot == 0 ? slot0 : slot1) = static_cast<const ppl::producer<int>*>(src);
+		}
+		auto poll_next() -> ppl::poll override {
+			current_value = slot0->value() + slot1->value();
+			return ppl::poll::ready;
+		}
+		auto value() const -> const int& override {
+			return current_value;
+		}
+	};
+
+	struct discard : ppl::sink<int> {
+		const ppl::producer<int>* slot0 = nullptr;
+		int last = 0;
+		auto name() const -> std::string override {
+			return "Discard";
+		}
+		void connect(const ppl::node* src, int slot) override {
+			if (slot == 0) {
+				slot0 = static_cast<const ppl::producer<int>*>(src);
+			}
+		}
+		auto poll_next() -> ppl::poll override {
+			last = slot0->value();
+			return ppl::poll::ready;
+		}
+	};
+
+	using node_id = ppl::pipeline::node_id;
+
+	// Each builder adds a valid graph of about n nodes to p and returns its last edge (src, dst),
+	// which the is_valid() benchmark cuts and restores.
+
+	// source -> increment -> ... -> increment -> sink, into a pipeline or a pipeline_builder
+	template<typename Graph>
+	auto build_chain(Graph& p, std::size_t n) -> std::pair<node_id, node_id> {
+		auto last = p.template create_node<ticker>();
+		for (auto i = 2u; i < n; ++i) {
+			auto next = p.template create_node<increment>();
+			p.connect(last, next, 0);
+			last = next;
+		}
+		auto sink = p.template create_node<discard>();
+		p.connect(last, sink, 0);
+		return {last, sink};
+	}
+
+	// one source feeding n - 1 sinks
+	auto build_fan_out(ppl::pipeline& p, std::size_t n) -> std::pair<node_id, node_id> {
+		auto src = p.create_node<ticker>();
+		auto sink = node_id{};
+		for (auto i = 1u; i < n; ++i) {
+			sink = p.create_node<discard>();
+			p.connect(src, sink, 0);
+		}
+		return {src, sink};
+	}
+
+	// one source fanning out to parallel increments, summed back together pairwise into one sink
+	auto build_diamond(ppl::pipeline& p, std::size_t n) -> std::pair<node_id, node_id> {
+		auto src = p.create_node<ticker>();
+		auto layer = std::vector<node_id>{};
+		for (auto i = 0u; i < std::max<std::size_t>(2, (n - 1) / 2); ++i) {
+			layer.push_back(p.create_node<increment>());
+			p.connect(src, layer.back(), 0);
+		}
+		while (layer.size() > 1) {
+			auto next = std::vector<node_id>{};
+			for (auto i = 0u; i + 1 < layer.size(); i += 2) {
+				next.push_back(p.create_node<add>());
+				p.connect(layer[i], next.back(), 0);
+				p.connect(layer[i + 1], next.back(), 1);
+			}
+			if (layer.size() % 2 == 1) {
+				next.push_back(layer.back());
+			}
+			layer = std::move(next);
+		}
+		auto sink = p.create_node<discard>();
+		p.connect(layer.front(), sink, 0);
+		return {layer.front(), sink};
+	}
+
+	// one source, then increments and adds whose inputs are drawn at random from earlier nodes;
+	// every node that ends up feeding nothing gets a sink of its own
+	auto build_random_dag(ppl::pipeline& p, std::size_t n) -> std::pair<node_id, node_id> {
+		auto rng = std::mt19937{6771};
+		auto producers = std::vector<node_id>{p.create_node<ticker>()};
+		auto used = std::vector<bool>{false};
+		auto pick = [&]() {
+			auto k = std::uniform_int_distribution<std::size_t>{0, producers.size() - 1}(rng);
+			used[k] = true;
+			return producers[k];
+		};
+		while (producers.size() < n * 3 / 4) {
+			if (rng() % 2 == 0) {
+				auto next = p.create_node<increment>();
+				p.connect(pick(), next, 0);
+				producers.push_back(next);
+			}
+			else {
+				auto next = p.create_node<add>();
+				p.connect(pick(), next, 0);
+				p.connect(pick(), next, 1);
+				producers.push_back(next);
+			}
+			used.push_back(false);
+		}
+		auto last = std::pair<node_id, node_id>{};
+		for (auto k = 0u; k < producers.size(); ++k) {
+			if (!used[k]) {
+				last = {producers[k], p.create_node<discard>()};
+				p.connect(last.first, last.second, 0);
+			}
+		}
+		return last;
+	}
+
+	struct topology {
+		const char* name;
+		std::function<std::pair<node_id, node_id>(ppl::pipeline&, std::size_t)> build;
+	};
+
+	auto topologies() -> std::vector<topology> {
+		return {{"chain", build_chain<ppl::pipeline>},
+		        {"fan-out", build_fan_out},
+		        {"diamond", build_diamond},
+		        {"random DAG", build_random_dag}};
+	}
+
+	auto label(const topology& t, std::size_t n, const char* what) -> std::string {
+		return std::string{what} + " " + t.name + " " + std::to_string(n);
+	}
+} // namespace
+
+TEST_CASE("step", "[step]") {
+	auto n = GENERATE(std::size_t{10}, std::size_t{1000}, std::size_t{60000});
+	for (auto& t : topologies()) {
+		ppl::pipeline p{};
+		t.build(p, n);
+		p.step(); // compiles the plan
+		BENCHMARK(label(t, n, "step serial")) {
+			return p.step();
+		};
+
+		p.set_options({ppl::execution_mode::work_stealing});
+		p.step();
+		BENCHMARK(label(t, n, "step work_stealing")) {
+			return p.step();
+		};
+	}
+}
+
+TEST_CASE("is_valid", "[is_valid]") {
+	auto n = GENERATE(std::size_t{10}, std::size_t{1000}, std::size_t{60000});
+	for (auto& t : topologies()) {
+		ppl::pipeline p{};
+		auto [src, dst] = t.build(p, n);
+		BENCHMARK(label(t, n, "is_valid cached")) {
+			return p.is_valid();
+		};
+		// removing an edge is what forces the components to be recounted
+		BENCHMARK(label(t, n, "is_valid after disconnect and connect")) {
+			p.disconnect(src, dst);
+			p.connect(src, dst, 0);
+			return p.is_valid();
+		};
+	}
+}
+
+TEST_CASE("construction and teardown", "[connect]") {
+	auto n = GENERATE(std::size_t{10}, std::size_t{1000}, std::size_t{60000});
+	for (auto& t : topologies()) {
+		BENCHMARK(label(t, n, "build and destroy")) {
+			ppl::pipeline p{};
+			t.build(p, n);
+			return p.is_valid();
+		};
+	}
+	BENCHMARK("build and destroy chain " + std::to_string(n) + " with pipeline_builder") {
+		ppl::pipeline p{};
+		auto builder = ppl::pipeline_builder{};
+		builder.reserve(n, n - 1);
+		build_chain(builder, n);
+		builder.commit(p);
+		return p.is_valid();
+	};
+}
+
+TEST_CASE("operator<<", "[print]") {
+	auto n = GENERATE(std::size_t{10}, std::size_t{1000}, std::size_t{60000});
+	for (auto& t : topologies()) {
+		ppl::pipeline p{};
+		t.build(p, n);
+		BENCHMARK(label(t, n, "print DOT")) {
+			auto os = std::ostringstream{};
+			os << p;
+			return os.str().size();
+		};
+	}
+}
@@ -1,4 +1,12 @@
 #include "./pipeline.h"
+#include "./task_scheduler.h"
+#include "./trace_writer.h"
+#include "./worker_pool.h"
+
+#include <bit>
+#include <mutex>
+#include <numeric>
+#include <thread>
 
 //static using namespace ppl;
 
@@ -30,178 +38,977 @@ const char * ppl::pipeline_error::what() const noexcept{
 // In this state, the pipeline should logically contain 0 nodes.
 // You may provide a destructor to clean up if necessary.
 
-ppl::pipeline::pipeline() {
-	this->next_id_ = 1;
-	this->connections_ = std::unordered_map<ppl::pipeline::node_id, std::vector<ppl::pipeline::node_id>>{};
-	this->nodes_ = std::unordered_map<ppl::pipeline::node_id, std::unique_ptr<ppl::node>>{};
-	this->sources_ = std::unordered_set<ppl::pipeline::node_id>{};
-	this->sinks_ = std::unordered_set<ppl::pipeline::node_id>{};
-	this->node_status_ = std::unordered_map<ppl::pipeline::node_id, ppl::poll>{};
-}
+ppl::pipeline::pipeline() = default;
 
-ppl::pipeline::pipeline(ppl::pipeline&& other) noexcept {
-	this->next_id_ = other.next_id_;
-	this->connections_ = std::move(other.connections_);
-	this->nodes_ = std::move(other.nodes_);
-	this->sources_ = std::move(other.sources_);
-	this->sinks_ = std::move(other.sinks_);
-	this->node_status_ = std::move(other.node_status_);
+ppl::pipeline::pipeline(std::pmr::memory_resource* resource)
+: resource_(resource) {}
 
-	other.next_id_ = 1;
-	other.connections_ = std::unordered_map<ppl::pipeline::node_id, std::vector<ppl::pipeline::node_id>>{};
-	other.nodes_ = std::unordered_map<ppl::pipeline::node_id, std::unique_ptr<ppl::node>>{};
-	other.sources_ = std::unordered_set<ppl::pipeline::node_id>{};
-	other.sinks_ = std::unordered_set<ppl::pipeline::node_id>{};
-	other.node_status_ = std::unordered_map<ppl::pipeline::node_id, ppl::poll>{};
+ppl::pipeline::~pipeline() = default;
+
+ppl::pipeline::pipeline(ppl::pipeline&& other) noexcept {
+	*this = std::move(other);
 }
 
 auto ppl::pipeline::operator=(ppl::pipeline&& other) noexcept -> pipeline& {
-	this->next_id_ = other.next_id_;
-	this->connections_ = std::move(other.connections_);
-	this->nodes_ = std::move(other.nodes_);
-	this->sources_ = std::move(other.sources_);
-	this->sinks_ = std::move(other.sinks_);
-	this->node_status_ = std::move(other.node_status_);
-
-	other.next_id_ = 1;
-	other.connections_ = std::unordered_map<ppl::pipeline::node_id, std::vector<ppl::pipeline::node_id>>{};
-	other.nodes_ = std::unordered_map<ppl::pipeline::node_id, std::unique_ptr<ppl::node>>{};
-	other.sources_ = std::unordered_set<ppl::pipeline::node_id>{};
-	other.sinks_ = std::unordered_set<ppl::pipeline::node_id>{};
-	other.node_status_ = std::unordered_map<ppl::pipeline::node_id, ppl::poll>{};
+	if (this == &other){
+		return *this;
+	}
+	this->take_graph(other);
+	this->options_ = std::exchange(other.options_, {});
+	this->pool_ = std::exchange(other.pool_, nullptr);
+	this->scheduler_ = std::exchange(other.scheduler_, nullptr);
+	this->trace_ = std::exchange(other.trace_, nullptr);
 
 	return *this;
 }
 
+void ppl::pipeline::take_graph(pipeline& other) noexcept {
+	// release our nodes while their resource is still the one they came from
+	this->slots_ = std::exchange(other.slots_, {});
+	this->stats_ = std::move(other.stats_);
+	other.stats_.clear();
+	this->closed_ = std::move(other.closed_);
+	other.closed_.clear();
+	this->resource_ = std::exchange(other.resource_, std::pmr::get_default_resource());
+	this->free_slots_ = std::exchange(other.free_slots_, {});
+	this->node_count_ = std::exchange(other.node_count_, 0);
+	this->created_ = std::exchange(other.created_, 0);
+	this->source_count_ = std::exchange(other.source_count_, 0);
+	this->sink_count_ = std::exchange(other.sink_count_, 0);
 
-// get_dependencies & is_valid non-const & const
+	this->unfilled_slots_ = std::exchange(other.unfilled_slots_, 0);
+	this->dangling_nodes_ = std::exchange(other.dangling_nodes_, 0);
+	this->component_count_ = std::exchange(other.component_count_, 0);
+	this->components_dirty_ = std::exchange(other.components_dirty_, false);
+	this->next_order_ = std::exchange(other.next_order_, 0);
+	this->has_cycle_ = std::exchange(other.has_cycle_, false);
+	this->order_dirty_ = std::exchange(other.order_dirty_, false);
 
+	this->plan_ = std::exchange(other.plan_, {});
+	this->plan_dirty_ = other.plan_dirty_.exchange(true);
+}
 
-// const version
 
+// node storage
 
+auto ppl::pipeline::slot_index(node_id id) const -> std::size_t {
+	auto index = slot_index_unchecked(id);
+	if (id == no_node || index >= this->slots_.size() || this->slots_[index].instance == nullptr
+	    || make_id(index, this->slots_[index].generation) != id)
+	{
+		throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
+	}
+	return index;
+}
 
+auto ppl::pipeline::allocate_slot() -> std::size_t {
+	if (this->free_slots_.empty()){
+		this->slots_.emplace_back(this->resource_);
+		if (!this->stats_.empty()){
+			this->stats_.emplace_back();
+		}
+		this->closed_.emplace_back(false);
+		return this->slots_.size() - 1;
+	}
+	auto index = this->free_slots_.back();
+	this->free_slots_.pop_back();
+	return index;
+}
 
-// non-const version
-auto ppl::pipeline::is_valid() -> bool {
-	for (auto& [id, conn] : this->connections_){
-		if (this->sources_.count(id)){
+void ppl::pipeline::release_slot(std::size_t index) {
+	auto& slot_n = this->slots_[index];
+	--this->node_count_;
+	this->source_count_ -= slot_n.is_source;
+	this->sink_count_ -= slot_n.is_sink;
+
+	++slot_n.generation;
+	slot_n.inputs.clear();
+	slot_n.dependents.clear();
+	if (this->running_){
+		// the slot is only reused once the node is reclaimed, so that its counters stay its own until then
+		this->retired_.emplace_back(std::move(slot_n.instance), index);
+		return;
+	}
+	slot_n.instance = nullptr;	// release memory
+	if (!this->stats_.empty()){
+		this->stats_[index] = {};
+	}
+	this->closed_[index] = false;
+	// free_slots_ never holds more entries than slots_, so it has the capacity
+	this->free_slots_.push_back(index);
+}
+
+void ppl::pipeline::reclaim_retired() {
+	for (auto& [instance, index] : this->retired_){
+		instance = nullptr;
+		if (!this->stats_.empty()){
+			this->stats_[index] = {};
+		}
+		this->closed_[index] = false;
+		this->free_slots_.push_back(index);
+	}
+	this->retired_.clear();
+}
+
+void ppl::pipeline::wire(node_slot& dst, const node* source, int slot) {
+	// a sink fed from somewhere new gets polled again, even if it closed itself before
+	this->closed_[static_cast<std::size_t>(&dst - this->slots_.data())].store(false, std::memory_order_relaxed);
+	if (this->running_){
+		this->rewire_pending_ = true;
+		return;
+	}
+	dst.instance->connect(source, slot);
+}
+
+void ppl::pipeline::add_edge(node_id src_id, node_id dst_id, int slot) {
+	auto& src = this->slots_[this->slot_index(src_id)];
+	auto& dst = this->slots_[this->slot_index(dst_id)];
+
+	// if src is sink or dst is source, throw error
+	if (src.is_sink || dst.is_source){
+		throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
+	}
+	if (slot < 0 || static_cast<std::size_t>(slot) >= dst.inputs.size()){
+		throw ppl::pipeline_error(ppl::pipeline_error_kind::no_such_slot);
+	}
+	auto& input = dst.inputs[static_cast<std::size_t>(slot)];
+	if (input != no_node){
+		throw ppl::pipeline_error(ppl::pipeline_error_kind::slot_already_used);
+	}
+
+	// type mismatching
+	if (!types_match(*src.instance, *dst.instance, slot)){
+		throw ppl::pipeline_error(ppl::pipeline_error_kind::connection_type_mismatch);
+	}
+
+	// node.connect usage need to be done here
+	this->wire(dst, src.instance.get(), slot);
+
+	input = src_id;
+	src.dependents.emplace_back(dst_id, slot);
+}
+
+void ppl::pipeline::connect_recorded_inputs() {
+	for (auto& slot_n : this->slots_){
+		if (slot_n.instance == nullptr){
 			continue;
 		}
-		for (auto& con_id : conn){	// traverse all slots
-			if (con_id == id){
-				return false;
+		for (auto slot = 0u; slot < slot_n.inputs.size(); ++slot){
+			auto* source = static_cast<const node*>(nullptr);
+			if (slot_n.inputs[slot] != no_node){
+				source = this->slots_[this->slot_index(slot_n.inputs[slot])].instance.get();
 			}
+			slot_n.instance->connect(source, static_cast<int>(slot));
 		}
 	}
+}
 
-	// All non-sink nodes must have at least one dependent.
-	for (auto& [id, conn] : this->connections_){
-		if (this->sinks_.count(id)){
+void ppl::pipeline::remove_dependent(node_id src_id, node_id dst_id, int slot) {
+	auto& deps = this->slots_[slot_index_unchecked(src_id)].dependents;
+	auto it = std::find(deps.begin(), deps.end(), std::make_pair(dst_id, slot));
+	if (it != deps.end()){
+		deps.erase(it);
+	}
+}
+
+
+// incremental validity
+
+void ppl::pipeline::validity_on_create(std::size_t index) {
+	auto& slot_n = this->slots_[index];
+	++this->node_count_;
+	this->source_count_ += slot_n.is_source;
+	this->sink_count_ += slot_n.is_sink;
+
+	this->unfilled_slots_ += slot_n.inputs.size();
+	if (!slot_n.is_sink){
+		++this->dangling_nodes_;
+	}
+	slot_n.component_parent = index;
+	++this->component_count_;
+	// erased nodes leave gaps in the order, which every plan compile walks, so close them before they pile up
+	if (this->next_order_ >= 2 * this->node_count_){
+		slot_n.topo_order = this->next_order_; // not yet ordered, so left out
+		this->compact_order();
+	}
+	slot_n.topo_order = this->next_order_++;
+}
+
+// Called before any of the node's edges are removed.
+void ppl::pipeline::validity_on_erase(std::size_t index) {
+	auto& slot_n = this->slots_[index];
+	const auto& conn = slot_n.inputs;
+	const auto& deps = slot_n.dependents;
+	auto self = make_id(index, slot_n.generation);
+	auto has_edges = !deps.empty();
+
+	for (auto it = conn.begin(); it != conn.end(); ++it){
+		if (*it == no_node){
+			--this->unfilled_slots_;
 			continue;
 		}
+		has_edges = true;
+		if (*it == self || std::find(conn.begin(), it, *it) != it){
+			continue; // input node already handled
+		}
+		// the input node loses every edge into this one; if that was all it had, it is left dangling
+		auto into_n = static_cast<std::size_t>(std::count(it, conn.end(), *it));
+		if (this->slots_[slot_index_unchecked(*it)].dependents.size() == into_n){
+			++this->dangling_nodes_;
+		}
+	}
+	for (auto& [dst_id, _] : deps){
+		if (dst_id != self){
+			++this->unfilled_slots_;
+		}
+	}
+	if (deps.empty() && !slot_n.is_sink){
+		--this->dangling_nodes_;
+	}
+
+	if (!has_edges && !this->components_dirty_){
+		// an isolated node is its own singleton component, and nothing else points to it
+		--this->component_count_;
+	}
+	else {
+		this->components_dirty_ = true;
+	}
+
+	// removing a node keeps a topological order valid, but may break the last cycle
+	if (this->has_cycle_){
+		this->order_dirty_ = true;
+	}
+}
+
+// Called after src -> dst has been recorded.
+void ppl::pipeline::validity_on_connect(std::size_t src, std::size_t dst) {
+	--this->unfilled_slots_;
+	if (this->slots_[src].dependents.size() == 1){
+		--this->dangling_nodes_;
+	}
 
-		auto has_no_dependent = this->get_dependencies(id).empty();
-		if (has_no_dependent){
-			return false;
+	if (!this->components_dirty_){
+		auto a = this->find_component(src);
+		auto b = this->find_component(dst);
+		if (a != b){
+			this->slots_[a].component_parent = b;
+			--this->component_count_;
 		}
 	}
 
-	// There is at least 1 source node.
-	if (this->sources_.empty()){
-		return false;
+	if (!this->has_cycle_ && !this->order_dirty_){
+		this->reorder_after_connect(src, dst);
+	}
+}
+
+// Called after one src -> dst edge has been removed.
+void ppl::pipeline::validity_on_disconnect(std::size_t src) {
+	++this->unfilled_slots_;
+	if (this->slots_[src].dependents.empty()){
+		++this->dangling_nodes_;
+	}
+	this->components_dirty_ = true;
+	if (this->has_cycle_){
+		this->order_dirty_ = true;
+	}
+}
+
+auto ppl::pipeline::find_component(std::size_t index) -> std::size_t {
+	auto& slots = this->slots_;
+	while (slots[index].component_parent != index){
+		slots[index].component_parent = slots[slots[index].component_parent].component_parent; // path halving
+		index = slots[index].component_parent;
+	}
+	return index;
+}
+
+void ppl::pipeline::recount_components() {
+	this->component_count_ = 0;
+	std::vector<bool> visited(this->slots_.size(), false);
+	std::vector<std::size_t> stack{};
+	for (auto root = 0u; root < this->slots_.size(); ++root){
+		if (this->slots_[root].instance == nullptr || visited[root]){
+			continue;
+		}
+		++this->component_count_;
+		visited[root] = true;
+		stack.push_back(root);
+		while (!stack.empty()){
+			auto& slot_n = this->slots_[stack.back()];
+			stack.pop_back();
+			slot_n.component_parent = root;
+			auto visit = [&](node_id id) {
+				auto next = slot_index_unchecked(id);
+				if (!visited[next]){
+					visited[next] = true;
+					stack.push_back(next);
+				}
+			};
+			for (auto dep : slot_n.inputs){
+				if (dep != no_node){
+					visit(dep);
+				}
+			}
+			for (auto& [dep, _] : slot_n.dependents){
+				visit(dep);
+			}
+		}
+	}
+	this->components_dirty_ = false;
+}
+
+void ppl::pipeline::reorder_after_connect(std::size_t src, std::size_t dst) {
+	auto& slots = this->slots_;
+	auto lower = slots[dst].topo_order;
+	auto upper = slots[src].topo_order;
+	if (lower > upper){
+		return; // already ordered
+	}
+
+	// forward search from dst within the affected region; reaching src closes a cycle
+	std::vector<std::size_t> forward{};
+	std::unordered_set<std::size_t> seen{dst};
+	std::vector<std::size_t> stack{dst};
+	while (!stack.empty()){
+		auto n = stack.back();
+		stack.pop_back();
+		forward.push_back(n);
+		for (auto& [next_id, _] : slots[n].dependents){
+			auto next = slot_index_unchecked(next_id);
+			if (next == src){
+				this->has_cycle_ = true;
+				return;
+			}
+			if (slots[next].topo_order < upper && seen.insert(next).second){
+				stack.push_back(next);
+			}
+		}
 	}
 
+	// backward search from src within the affected region
+	std::vector<std::size_t> backward{};
+	seen.insert(src);
+	stack.push_back(src);
+	while (!stack.empty()){
+		auto n = stack.back();
+		stack.pop_back();
+		backward.push_back(n);
+		for (auto prev_id : slots[n].inputs){
+			if (prev_id == no_node){
+				continue;
+			}
+			auto prev = slot_index_unchecked(prev_id);
+			if (slots[prev].topo_order > lower && seen.insert(prev).second){
+				stack.push_back(prev);
+			}
+		}
+	}
+
+	// reuse the affected positions: everything reaching src goes before everything reachable from dst
+	auto by_order = [&slots](std::size_t a, std::size_t b) { return slots[a].topo_order < slots[b].topo_order; };
+	std::sort(forward.begin(), forward.end(), by_order);
+	std::sort(backward.begin(), backward.end(), by_order);
+	std::vector<std::size_t> positions{};
+	positions.reserve(forward.size() + backward.size());
+	for (auto n : backward){
+		positions.push_back(slots[n].topo_order);
+	}
+	for (auto n : forward){
+		positions.push_back(slots[n].topo_order);
+	}
+	std::sort(positions.begin(), positions.end());
+	auto i = 0u;
+	for (auto n : backward){
+		slots[n].topo_order = positions[i++];
+	}
+	for (auto n : forward){
+		slots[n].topo_order = positions[i++];
+	}
+}
+
+void ppl::pipeline::compact_order() {
+	auto none = this->slots_.size();
+	std::vector<std::size_t> by_order(this->next_order_, none);
+	for (auto index = 0u; index < this->slots_.size(); ++index){
+		if (this->slots_[index].instance != nullptr && this->slots_[index].topo_order < this->next_order_){
+			by_order[this->slots_[index].topo_order] = index;
+		}
+	}
+	this->next_order_ = 0;
+	for (auto index : by_order){
+		if (index != none){
+			this->slots_[index].topo_order = this->next_order_++;
+		}
+	}
+}
+
+void ppl::pipeline::recompute_order() {
+	auto& slots = this->slots_;
+	std::vector<std::size_t> in_degree(slots.size(), 0);
+	std::vector<std::size_t> ready{};
+	for (auto n = 0u; n < slots.size(); ++n){
+		if (slots[n].instance == nullptr){
+			continue;
+		}
+		// unfilled slots are not edges
+		auto& conn = slots[n].inputs;
+		in_degree[n] = conn.size() - static_cast<std::size_t>(std::count(conn.begin(), conn.end(), no_node));
+		if (in_degree[n] == 0){
+			ready.push_back(n);
+		}
+	}
+
+	this->next_order_ = 0;
+	while (!ready.empty()){
+		auto n = ready.back();
+		ready.pop_back();
+		slots[n].topo_order = this->next_order_++;
+		for (auto& [next_id, _] : slots[n].dependents){
+			auto next = slot_index_unchecked(next_id);
+			if (--in_degree[next] == 0){
+				ready.push_back(next);
+			}
+		}
+	}
+	// whatever is left over lies on or behind a cycle
+	this->has_cycle_ = this->next_order_ != this->node_count_;
+	for (auto n = 0u; n < slots.size(); ++n){
+		if (slots[n].instance != nullptr && in_degree[n] != 0){
+			slots[n].topo_order = this->next_order_++;
+		}
+	}
+	this->order_dirty_ = false;
+}
+
+auto ppl::pipeline::is_valid() -> bool {
+	auto lock = std::lock_guard{this->graph_mutex_};
+	return this->check_valid();
+}
+
+auto ppl::pipeline::check_valid() -> bool {
+	// All source slots for all nodes must be filled.
+	// All non-sink nodes must have at least one dependent.
+	// There is at least 1 source node.
 	// There is at least 1 sink node.
-	if (this->sinks_.empty()){
+	if (this->unfilled_slots_ != 0 || this->dangling_nodes_ != 0 || this->source_count_ == 0 || this->sink_count_ == 0){
 		return false;
 	}
 
 	// There are no subpipelines i.e. completely disconnected sections of the dataflow from the main pipeline.
-	// BFS
-	std::unordered_set<node_id> visited_node{};
-	std::queue<node_id> Q_0{};
-	for (auto& sNode: this->sinks_){
-		visited_node.insert(sNode);
-		Q_0.push(sNode);
-		break ;
-	}
-
-	while (!Q_0.empty()){
-		auto Q_size = Q_0.size();
-		for (auto i = 0u; i<Q_size; ++i){
-			auto n_id = Q_0.front();
-			Q_0.pop();
-			auto deps = this->connections_.at(n_id);
-			for (auto& dep: deps){
-				if (visited_node.count(dep) == 0){
-					visited_node.insert(dep);
-					Q_0.push(dep);
-				}
+	if (this->components_dirty_){
+		this->recount_components();
+	}
+	if (this->component_count_ != 1){
+		return false;
+	}
+
+	// There are no cycles.
+	if (this->order_dirty_){
+		this->recompute_order();
+	}
+	return !this->has_cycle_;
+}
+
+
+void ppl::pipeline::check_fragment(std::span<node* const> placeholders, const node* output) {
+	auto fail = [](const std::string& what) {
+		throw std::invalid_argument("composite: " + what);
+	};
+	auto output_dangling = false;
+	auto placeholders_found = std::size_t{0};
+	for (auto& slot_n : this->slots_){
+		if (slot_n.instance == nullptr){
+			continue;
+		}
+		if (std::find(placeholders.begin(), placeholders.end(), slot_n.instance.get()) != placeholders.end()){
+			if (slot_n.inputs.front() != no_node){
+				fail("an input placeholder is connected within the fragment");
 			}
-			auto cons = this->get_dependencies(n_id);
-			for (auto& con: cons){
-				if (visited_node.count(con.first) == 0){
-					visited_node.insert(con.first);
-					Q_0.push(con.first);
-				}
+			++placeholders_found;
+		}
+		if (slot_n.instance.get() == output){
+			output_dangling = slot_n.dependents.empty();
+		}
+	}
+	if (placeholders_found != placeholders.size()){
+		fail("an input placeholder is used for more than one input");
+	}
+	if (this->unfilled_slots_ != placeholders.size()){
+		fail("the fragment has unconnected slots besides its input placeholders");
+	}
+	if (this->dangling_nodes_ != (output_dangling ? 1u : 0u)){
+		fail("a node of the fragment other than its output has no dependent");
+	}
+	if (this->components_dirty_){
+		this->recount_components();
+	}
+	if (this->component_count_ != 1){
+		fail("the fragment is not connected");
+	}
+	if (this->order_dirty_){
+		this->recompute_order();
+	}
+	if (this->has_cycle_){
+		fail("the fragment has a cycle");
+	}
+}
+
+void ppl::pipeline::allocate_stats() {
+	if (this->stats_.empty()){
+		this->stats_.resize(this->slots_.size());
+	}
+}
+
+// Preconditions: the graph has no cycle and its topological order is up to date.
+auto ppl::pipeline::flatten(flat_graph& flat,
+                            std::uint64_t owner,
+                            std::span<node* const> placeholders,
+                            std::span<const std::size_t> fed_by,
+                            const node* output) -> std::size_t {
+	if (flat.collect_stats){
+		// a composite's fragment counts the polls of its nodes, whatever its own options say
+		this->allocate_stats();
+	}
+	std::vector<std::size_t> by_order(this->next_order_, this->slots_.size());
+	for (auto index = 0u; index < this->slots_.size(); ++index){
+		if (this->slots_[index].instance != nullptr){
+			by_order[this->slots_[index].topo_order] = index;
+		}
+	}
+
+	// flat_of[index]: the flat node whose values the node in slot index hands to its dependents
+	std::vector<std::size_t> flat_of(this->slots_.size(), 0);
+	auto output_at = std::size_t{0};
+	auto inner_fed_by = std::vector<std::size_t>{};
+	for (auto index : by_order){
+		if (index == this->slots_.size()){
+			continue;
+		}
+		auto& slot_n = this->slots_[index];
+		auto* instance = slot_n.instance.get();
+		auto serial = owner != 0 ? owner : slot_n.serial;
+		auto placeholder = std::find(placeholders.begin(), placeholders.end(), instance);
+		if (placeholder != placeholders.end()){
+			// placeholders are never polled, their consumers read the composite's input directly
+			flat_of[index] = fed_by[static_cast<std::size_t>(placeholder - placeholders.begin())];
+		}
+		else if (auto* parts = instance->as_composite(); parts != nullptr){
+			inner_fed_by.clear();
+			for (auto src_id : slot_n.inputs){
+				inner_fed_by.push_back(flat_of[slot_index_unchecked(src_id)]);
+			}
+			flat_of[index] = parts->fragment->flatten(flat, serial, parts->inputs, inner_fed_by, parts->output);
+		}
+		else {
+			flat_of[index] = flat.nodes.size();
+			flat.nodes.push_back(instance);
+			flat.serials.push_back(serial);
+			flat.stats.push_back(flat.collect_stats ? &this->stats_[index] : nullptr);
+			flat.closed.push_back(&this->closed_[index]);
+			flat.is_sink.push_back(slot_n.is_sink);
+			flat.make_stream_channel.push_back(slot_n.make_stream_channel);
+			for (auto src_id : slot_n.inputs){
+				auto src = slot_index_unchecked(src_id);
+				flat.inputs.push_back(flat_of[src]);
+				flat.input_nodes.push_back(this->slots_[src].instance.get());
 			}
+			flat.input_offsets.push_back(flat.inputs.size());
+		}
+		if (instance == output){
+			output_at = flat_of[index];
 		}
+	}
+	return output_at;
+}
 
+// Preconditions: this->is_valid()
+// Topologically sorts the graph once and flattens it into plan_, so that step() only has to walk a vector.
+void ppl::pipeline::compile_plan() {
+	if (!this->check_valid()){
+		throw std::runtime_error("pipeline is not valid, no call for step()");
 	}
 
-	if (visited_node.size() != this->nodes_.size()){
-		return false;
+	// is_valid() leaves an up to date topological order behind, which flatten() follows into every composite
+	auto flat = flat_graph{};
+	flat.collect_stats = this->options_.collect_stats;
+	flat.nodes.reserve(this->node_count_);
+	this->flatten(flat, 0, {}, {}, nullptr);
+	auto n = flat.nodes.size();
+	std::vector<std::size_t> fan_out(n, 0);
+	for (auto src : flat.inputs){
+		++fan_out[src];
+	}
+
+	// fuse linear chains: a node with a single input slot whose producer feeds nothing else joins its producer's
+	// unit, straight after it, so a whole chain is scheduled as one task and only publishes one status per tick
+	auto none = n;
+	std::vector<std::size_t> head(n, none);
+	std::vector<std::size_t> next_in_unit(n, none);
+	for (auto f = 0u; f < n; ++f){
+		head[f] = f;
+		if (this->options_.fuse_chains && flat.input_offsets[f + 1] - flat.input_offsets[f] == 1){
+			auto src = flat.inputs[flat.input_offsets[f]];
+			if (fan_out[src] == 1){
+				head[f] = head[src];
+				next_in_unit[src] = f;
+			}
+		}
 	}
-	for (auto& [id, _] : this->nodes_){
-		if (visited_node.count(id) == 0){
-			return false;
+
+	// group the units into levels: a unit's level is one past the deepest unit feeding its first node,
+	// so units within a level never depend on each other
+	std::vector<std::size_t> depth(n, 0);
+	std::vector<std::size_t> level_sizes{};
+	for (auto f = 0u; f < n; ++f){
+		if (head[f] != f){
+			continue;
+		}
+		for (auto j = flat.input_offsets[f]; j < flat.input_offsets[f + 1]; ++j){
+			depth[f] = std::max(depth[f], depth[head[flat.inputs[j]]] + 1);
+		}
+		if (depth[f] >= level_sizes.size()){
+			level_sizes.resize(depth[f] + 1, 0);
 		}
+		++level_sizes[depth[f]];
+	}
+	auto plan = execution_plan{};
+	plan.level_offsets.assign(level_sizes.size() + 1, 0);
+	for (auto level = 0u; level < level_sizes.size(); ++level){
+		plan.level_offsets[level + 1] = plan.level_offsets[level] + level_sizes[level];
 	}
 
-	// BFS from sink to check circle
-	std::unordered_set<node_id> visited{};
-	std::queue<node_id> Q{};
-	for (auto& sNode: this->sinks_){
-		visited.insert(sNode);
-		Q.push(sNode);
+	// level by level is still a topological order, and so is each chain within its unit
+	auto unit_count = plan.level_offsets.back();
+	std::vector<std::size_t> unit_heads(unit_count, none);
+	auto fill = std::vector<std::size_t>(plan.level_offsets.begin(), plan.level_offsets.end() - 1);
+	for (auto f = 0u; f < n; ++f){
+		if (head[f] == f){
+			unit_heads[fill[depth[f]]++] = f;
+		}
 	}
+	std::vector<std::size_t> plan_index(n, 0);
+	std::vector<std::size_t> flat_at(n, 0);
+	plan.serials.resize(n);
+	plan.nodes.resize(n);
+	plan.stats.resize(n);
+	plan.closed.resize(n);
+	plan.is_sink.resize(n);
+	plan.make_stream_channel.resize(n);
+	plan.unit_of.resize(n);
+	plan.unit_offsets.reserve(unit_count + 1);
+	auto entry = std::size_t{0};
+	for (auto u = 0u; u < unit_count; ++u){
+		plan.unit_offsets.push_back(entry);
+		for (auto f = unit_heads[u]; f != none; f = next_in_unit[f], ++entry){
+			plan_index[f] = entry;
+			flat_at[entry] = f;
+			plan.serials[entry] = flat.serials[f];
+			plan.nodes[entry] = flat.nodes[f];
+			plan.stats[entry] = flat.stats[f];
+			plan.closed[entry] = flat.closed[f];
+			plan.is_sink[entry] = flat.is_sink[f];
+			plan.make_stream_channel[entry] = flat.make_stream_channel[f];
+			plan.unit_of[entry] = u;
+		}
+	}
+	plan.unit_offsets.push_back(entry);
 
-	while (!Q.empty()){
-		auto Q_size = Q.size();
-		std::unordered_set<node_id> new_visited;
-		for (auto i = 0u; i<Q_size; ++i){
-			auto n_id = Q.front();
-			Q.pop();
-			auto deps = this->connections_.at(n_id);
-			for (auto& dep: deps){
-				if (new_visited.count(dep) == 0){
-					new_visited.insert(dep);
-					Q.push(dep);
-				}
+	// slot wiring, in slot order
+	plan.input_offsets.reserve(n + 1);
+	plan.input_offsets.push_back(0);
+	plan.inputs.reserve(flat.inputs.size());
+	plan.input_nodes.reserve(flat.inputs.size());
+	for (auto i = 0u; i < n; ++i){
+		auto f = flat_at[i];
+		for (auto j = flat.input_offsets[f]; j < flat.input_offsets[f + 1]; ++j){
+			plan.inputs.push_back(plan_index[flat.inputs[j]]);
+			plan.input_nodes.push_back(flat.input_nodes[j]);
+		}
+		plan.input_offsets.push_back(plan.inputs.size());
+		if (plan.is_sink[i]){
+			plan.sinks.push_back(i);
+		}
+	}
+	plan.dependent_offsets.assign(n + 1, 0);
+	for (auto src : plan.inputs){
+		++plan.dependent_offsets[src + 1];
+	}
+	for (auto i = 0u; i < n; ++i){
+		plan.dependent_offsets[i + 1] += plan.dependent_offsets[i];
+	}
+	plan.dependents.resize(plan.inputs.size());
+	auto next_dependent = std::vector<std::size_t>(plan.dependent_offsets.begin(), plan.dependent_offsets.end() - 1);
+	for (auto i = 0u; i < n; ++i){
+		for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+			plan.dependents[next_dependent[plan.inputs[j]]++] = i;
+		}
+	}
+	// a consumer may take (move) its input's value when it is that producer's only dependent edge
+	for (auto i = 0u; i < n; ++i){
+		for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+			auto src = plan.inputs[j];
+			auto exclusive = plan.dependent_offsets[src + 1] - plan.dependent_offsets[src] == 1;
+			plan.nodes[i]->set_exclusive_input(static_cast<int>(j - plan.input_offsets[i]), exclusive);
+		}
+	}
+	// an edge runs in batches when its producer has no other dependent and both ends opt in
+	plan.batch_edge.assign(n, false);
+	if (this->options_.batch_size != 0){
+		for (auto i = 0u; i < n; ++i){
+			if (plan.dependent_offsets[i + 1] - plan.dependent_offsets[i] == 1){
+				auto dst = plan.dependents[plan.dependent_offsets[i]];
+				plan.batch_edge[i] = plan.nodes[i]->batch_output() && plan.nodes[dst]->batch_input();
 			}
 		}
-		for(auto& n_id: new_visited){
-			if (visited.count(n_id) == 0){
-				visited.insert(n_id);
-			} else {
-				// There are cycles.
-				return false;
+	}
+	plan.status.assign(n, poll::empty);
+	plan.pending = std::vector<std::atomic<std::size_t>>(unit_count);
+	plan.trace_events.resize(n);
+
+	plan.dead.assign(n, false);
+	plan.live_dependents.resize(n);
+	for (auto i = 0u; i < n; ++i){
+		plan.live_dependents[i] = plan.dependent_offsets[i + 1] - plan.dependent_offsets[i];
+	}
+	plan.live_sinks = plan.sinks.size();
+
+	this->plan_ = std::move(plan);
+	this->plan_dirty_ = false;
+	// sinks that closed themselves stay closed, so the branches feeding only them are not revived; a sink that
+	// only closed because its inputs did is polled again, in case it has been rewired to live ones
+	for (auto x : this->plan_.sinks){
+		if (this->plan_.closed[x]->load(std::memory_order_relaxed) && !this->plan_.dead[x]){
+			this->mark_dead(x);
+		}
+	}
+}
+
+namespace {
+	void record_poll(ppl::node_stats& stats, ppl::poll status, std::chrono::steady_clock::duration took) {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(took);
+		++stats.polls;
+		++(status == ppl::poll::ready ? stats.ready : status == ppl::poll::empty ? stats.empty : stats.closed);
+		auto bucket = std::bit_width(static_cast<std::uint64_t>(std::max(ns.count(), decltype(ns.count()){0})));
+		++stats.latency_histogram[std::min<std::size_t>(bucket, stats.latency_histogram.size() - 1)];
+		stats.total_latency += ns;
+	}
+} // namespace
+
+// Polls plan entry i and works out its status for this tick.
+template<bool Instrumented>
+auto ppl::pipeline::evaluate(std::size_t i) -> bool {
+	auto& plan = this->plan_;
+	if (plan.dead[i]){
+		plan.status[i] = poll::closed; // nothing downstream still listens
+		return false;
+	}
+
+	// a closed input closes this node, otherwise an empty input skips it
+	auto inputs_status = poll::ready;
+	for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+		auto in = plan.status[plan.inputs[j]];
+		if (in == poll::closed){
+			inputs_status = poll::closed;
+			break;
+		}
+		if (in == poll::empty){
+			inputs_status = poll::empty;
+		}
+	}
+
+	// only a node whose every input is ready this tick is polled at all
+	plan.status[i] = inputs_status == poll::ready ? this->poll_entry<Instrumented>(i) : inputs_status;
+	return inputs_status == poll::ready;
+}
+
+// Polls plan entry i, whose inputs are all ready. Instrumented also times the poll and counts its outcome.
+template<bool Instrumented>
+auto ppl::pipeline::poll_entry(std::size_t i) -> poll {
+	if constexpr (Instrumented) {
+		auto start = std::chrono::steady_clock::now();
+		auto status = this->poll_entry<false>(i);
+		auto end = std::chrono::steady_clock::now();
+		if (this->options_.collect_stats){
+			record_poll(*this->plan_.stats[i], status, end - start);
+		}
+		if (this->trace_ != nullptr){
+			this->plan_.trace_events[i].push_back(
+			   {this->trace_->since_start(start), this->trace_->since_start(end), internal::trace_thread_id(), status});
+		}
+		return status;
+	}
+	auto& plan = this->plan_;
+	auto first = plan.input_offsets[i];
+	if (plan.input_offsets[i + 1] - first == 1 && plan.batch_edge[plan.inputs[first]]){
+		// the producer's whole batch is consumed at once
+		return plan.nodes[i]->consume_batch_erased(*plan.nodes[plan.inputs[first]]);
+	}
+	return plan.batch_edge[i] ? plan.nodes[i]->poll_batch_erased(this->options_.batch_size)
+	                          : plan.nodes[i]->poll_next();
+}
+
+// Runs plan unit u: its first entry as usual, then the rest of the chain for as long as values keep coming.
+// Every later entry has the previous one as its only input and is its only dependent, so the status is carried
+// along the chain and only stored for the last entry, the one other units read.
+template<bool Instrumented>
+void ppl::pipeline::evaluate_unit(std::size_t u) {
+	auto& plan = this->plan_;
+	auto first = plan.unit_offsets[u];
+	auto last = plan.unit_offsets[u + 1] - 1;
+	auto polled_last = this->evaluate<Instrumented>(first) && first == last;
+	auto status = plan.status[first];
+	for (auto i = first + 1; i <= last && status == poll::ready; ++i){
+		status = this->poll_entry<Instrumented>(i);
+		polled_last = i == last;
+	}
+	plan.status[last] = status;
+	// only a sink is remembered as closed, and only when the sink itself said so
+	if (polled_last && status == poll::closed && plan.is_sink[last]){
+		plan.closed[last]->store(true, std::memory_order_relaxed);
+	}
+}
+
+namespace {
+	auto worker_count(const ppl::run_options& options) -> std::size_t {
+		return options.workers != 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+	}
+} // namespace
+
+auto ppl::pipeline::worker_pool_for_run() -> internal::worker_pool& {
+	auto workers = worker_count(this->options_);
+	if (this->pool_ == nullptr || this->pool_->size() != workers){
+		this->pool_ = std::make_unique<internal::worker_pool>(workers);
+	}
+	return *this->pool_;
+}
+
+auto ppl::pipeline::scheduler_for_run() -> internal::task_scheduler& {
+	auto workers = worker_count(this->options_);
+	if (this->scheduler_ == nullptr || this->scheduler_->size() != workers
+	    || this->scheduler_->pin_requested() != this->options_.pin_workers)
+	{
+		this->scheduler_ = std::make_unique<internal::task_scheduler>(workers, this->options_.pin_workers);
+	}
+	return *this->scheduler_;
+}
+
+// One tick as a task graph: every unit waits for its inputs' pending count to drop to zero,
+// and whoever resolves its last input spawns it onto their own worker.
+template<bool Instrumented>
+void ppl::pipeline::step_work_stealing() {
+	auto& plan = this->plan_;
+	auto& scheduler = this->scheduler_for_run();
+	auto seeds = std::vector<std::size_t>{};
+	auto units = plan.unit_offsets.size() - 1;
+	for (auto u = 0u; u < units; ++u){
+		auto head = plan.unit_offsets[u];
+		auto inputs = plan.input_offsets[head + 1] - plan.input_offsets[head];
+		plan.pending[u].store(inputs, std::memory_order_relaxed);
+		if (inputs == 0){
+			seeds.push_back(u);
+		}
+	}
+	scheduler.run_round(seeds, units, [this, &scheduler](std::size_t u, std::size_t worker) {
+		auto& plan = this->plan_;
+		this->evaluate_unit<Instrumented>(u);
+		// only the last entry of a unit has dependents outside it, and each of them starts a unit
+		auto last = plan.unit_offsets[u + 1] - 1;
+		for (auto j = plan.dependent_offsets[last]; j < plan.dependent_offsets[last + 1]; ++j){
+			auto next = plan.unit_of[plan.dependents[j]];
+			// acq_rel: the last input to resolve publishes every input's status to the dependent
+			if (plan.pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1){
+				scheduler.spawn(worker, next);
 			}
 		}
+	});
+}
+
+auto ppl::pipeline::stats(node_id id) const -> const node_stats& {
+	static const auto never_collected = node_stats{};
+	auto index = this->slot_index(id);
+	return this->stats_.empty() ? never_collected : this->stats_[index];
+}
+
+auto ppl::pipeline::stats() const -> std::vector<std::pair<node_id, node_stats>> {
+	auto all = std::vector<std::pair<node_id, node_stats>>{};
+	all.reserve(this->node_count_);
+	for (auto index = 0u; index < this->slots_.size(); ++index){
+		auto& slot_n = this->slots_[index];
+		if (slot_n.instance != nullptr){
+			all.emplace_back(make_id(index, slot_n.generation),
+			                 this->stats_.empty() ? node_stats{} : this->stats_[index]);
+		}
+	}
+	std::sort(all.begin(), all.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	return all;
+}
+
+void ppl::pipeline::reset_stats() noexcept {
+	for (auto& stats : this->stats_){
+		stats = {};
+	}
+	for (auto& slot_n : this->slots_){
+		if (auto* parts = slot_n.instance != nullptr ? slot_n.instance->as_composite() : nullptr){
+			parts->fragment->reset_stats();
+		}
 	}
+}
 
-	return true;
+void ppl::pipeline::start_trace(const std::string& path) {
+	this->trace_ = std::make_unique<internal::trace_writer>(path);
 }
 
+void ppl::pipeline::stop_trace() {
+	this->trace_ = nullptr;
+}
 
+void ppl::pipeline::drain_trace() {
+	auto& plan = this->plan_;
+	for (auto i = 0u; i < plan.trace_events.size(); ++i){
+		if (!plan.trace_events[i].empty()){
+			this->trace_->polls(plan.serials[i], *plan.nodes[i], plan.trace_events[i]);
+			plan.trace_events[i].clear();
+		}
+	}
+}
 
-//precondition: this->is_valid()
-auto ppl::pipeline::step() ->bool {
-	if (!this->is_valid()){
-		throw std::runtime_error("pipeline is not valid, no call for step()");
+void ppl::pipeline::set_options(const run_options& options) {
+	if (options.collect_stats){
+		this->allocate_stats();
+	}
+	this->options_ = options;
+	this->plan_dirty_ = true; // the batch size decides which edges run in batches
+}
+
+auto ppl::pipeline::options() const noexcept -> const run_options& {
+	return this->options_;
+}
+
+// Polls every unit of the plan once, as the execution mode says.
+template<bool Instrumented>
+void ppl::pipeline::tick() {
+	auto& plan = this->plan_;
+	if (this->options_.mode == execution_mode::level_parallel){
+		auto& pool = this->worker_pool_for_run();
+		for (auto level = 0u; level + 1 < plan.level_offsets.size(); ++level){
+			auto first = plan.level_offsets[level];
+			// each unit only writes its own statuses, and only reads statuses of earlier levels
+			pool.parallel_for(plan.level_offsets[level + 1] - first,
+			                  [this, first](std::size_t u) { this->evaluate_unit<Instrumented>(first + u); });
+		}
+	}
+	else if (this->options_.mode == execution_mode::work_stealing){
+		this->step_work_stealing<Instrumented>();
+	}
+	else {
+		for (auto u = 0u; u + 1 < plan.unit_offsets.size(); ++u){
+			this->evaluate_unit<Instrumented>(u);
+		}
 	}
+}
 
+// Preconditions: this->is_valid()
+auto ppl::pipeline::step() -> bool {
 	// According to the poll result:
 	// If the node is closed, close all nodes that depend on it.
 	// If the node has no value, skip all nodes that depend on it.
@@ -209,7 +1016,6 @@ auto ppl::pipeline::step() ->bool {
 	// and all nodes that depend on it should be polled,
 	// and so on recursively.
 	// The tick ends once every node has been either polled, skipped, or closed.
-	// ready, empty, closed
 	//
 	// Returns: true if all sink nodes are now closed,
 	// or false otherwise.
@@ -217,120 +1023,343 @@ auto ppl::pipeline::step() ->bool {
 	// Notes: you are allowed to (but don't have to)
 	// avoid polling a node if all its dependent sink nodes are closed.
 
-	// topological ordering
-	std::queue<node_id> Q{};
-	std::unordered_set<node_id> settled{};
-	std::unordered_set<node_id> skipped{};
-	std::unordered_map<node_id,std::size_t> in_degree{};
-	std::unordered_map<node_id,poll> node_status{};
+	// the graph only changes through create_node, erase_node, connect and disconnect,
+	// so the plan (and its validation) carries over between ticks until one of them is called
+	if (this->plan_dirty_.load(std::memory_order_acquire)){
+		this->update_plan();
+	}
 
-	// calculate in_degree
-	for (auto& [id, conn] : this->connections_){
-		in_degree[id] = conn.size();
-		if (conn.empty() && !this->sources_.count(id)){
-			throw std::runtime_error("node is not source but has no dependency");
+	// the switch is made once per tick, so without stats or tracing the polling path carries no instrumentation
+	if (this->options_.collect_stats || this->trace_ != nullptr){
+		auto start = std::chrono::steady_clock::now();
+		this->tick<true>();
+		if (this->trace_ != nullptr){
+			this->trace_->tick(this->trace_->since_start(start),
+			                   this->trace_->since_start(std::chrono::steady_clock::now()));
+			this->drain_trace();
 		}
 	}
+	else {
+		this->tick<false>();
+	}
 
-	for (auto& [nid,node_n]: this->nodes_){
-		if (in_degree.at(nid) == 0){
-			Q.push(nid);
-			if (this->sources_.count(nid) == 0){
-				throw std::runtime_error("inD==0 but not source node");
-			}
+	auto& plan = this->plan_;
+	// liveness only changes here, between ticks, so parallel modes never race on it
+	for (auto x : plan.sinks){
+		if (plan.status[x] == poll::closed && !plan.dead[x]){
+			this->mark_dead(x);
 		}
-		auto cur_node = node_n.get();
-		node_status[nid] = cur_node->poll_next();
 	}
 
-	while (!Q.empty()){
-		auto cur_n_id = Q.front();
-		Q.pop();
+	return plan.live_sinks == 0;
+}
 
-		if (settled.count(cur_n_id)){
-			continue ;
-		}
-		settled.insert(cur_n_id);
+void ppl::pipeline::update_plan() {
+	auto lock = std::lock_guard{this->graph_mutex_};
+	if (this->running_ && (this->reconfigurations_ != 0 || !this->check_valid())){
+		// a reconfiguration is still under way: keep ticking the plan it has not touched
+		return;
+	}
+	this->compile_plan();
+	if (this->rewire_pending_){
+		this->connect_recorded_inputs();
+		this->rewire_pending_ = false;
+	}
+	// the old plan was the last thing referring to nodes erased since it was compiled
+	this->reclaim_retired();
+}
 
-//		auto cur_node = this->nodes_.at(cur_n_id).get();
-		auto cur_poll = node_status.at(cur_n_id);
+ppl::pipeline::reconfiguration::reconfiguration(pipeline& p)
+: p_(p) {
+	auto lock = std::lock_guard{this->p_.graph_mutex_};
+	++this->p_.reconfigurations_;
+}
 
-		if (this->sinks_.count(cur_n_id)){
-			continue ;
-		}
-		// probe next_nodes and update in_degree
-		if (cur_poll == poll::closed){
-			// if any node closed, check if it is sink_node
-			auto cons = this->get_dependencies(cur_n_id);
-			for (auto& [next_n_id, _]: cons){
+ppl::pipeline::reconfiguration::~reconfiguration() {
+	auto lock = std::lock_guard{this->p_.graph_mutex_};
+	--this->p_.reconfigurations_;
+}
 
+auto ppl::pipeline::reconfigure() -> reconfiguration {
+	return reconfiguration{*this};
+}
 
-				node_status[next_n_id] = poll::closed;
+// A run starts from a plan for the current graph, so only changes made while it runs can leave it on an older one.
+ppl::pipeline::active_run::active_run(pipeline& p_)
+: p(p_) {
+	auto lock = std::lock_guard{this->p.graph_mutex_};
+	if (this->p.plan_dirty_.load(std::memory_order_relaxed)){
+		this->p.compile_plan();
+	}
+	this->p.running_ = true;
+}
 
-				in_degree.at(next_n_id) -= 1;
-				if (in_degree.at(next_n_id) == 0){
-					Q.push(next_n_id);
-				}
+ppl::pipeline::active_run::~active_run() {
+	auto lock = std::lock_guard{this->p.graph_mutex_};
+	this->p.running_ = false;
+	if (this->p.rewire_pending_){
+		this->p.connect_recorded_inputs();
+		this->p.rewire_pending_ = false;
+	}
+	// nothing polls plan_ before it is recompiled, as the graph changed if anything was retired
+	this->p.reclaim_retired();
+}
 
+// Entry i will never be polled again: it is a closed sink, or every dependent it has is dead.
+// Inputs left without a live dependent die with it.
+void ppl::pipeline::mark_dead(std::size_t i) {
+	auto& plan = this->plan_;
+	auto stack = std::vector<std::size_t>{i};
+	plan.dead[i] = true;
+	while (!stack.empty()){
+		auto x = stack.back();
+		stack.pop_back();
+		if (plan.is_sink[x]){
+			--plan.live_sinks;
+		}
+		for (auto j = plan.input_offsets[x]; j < plan.input_offsets[x + 1]; ++j){
+			auto src = plan.inputs[j];
+			if (--plan.live_dependents[src] == 0 && !plan.dead[src]){
+				plan.dead[src] = true;
+				stack.push_back(src);
 			}
-			// if it is source, do nothing
-		} else if (cur_poll == poll::empty){
-			// skip all node that depend on it
-			auto cons = this->get_dependencies(cur_n_id);
-			for (auto& [next_n_id, _]: cons){
+		}
+	}
+}
+
+// Preconditions: is_valid() is true.
+// Run the pipeline until all sink nodes are closed. Equivalent to while(!step()) {}, but potentially more efficient.
+auto ppl::pipeline::run() -> void {
+	auto active = active_run{*this};
+	if (this->options_.mode == execution_mode::streaming){
+		this->run_streaming();
+		return;
+	}
+	while (!this->step()){
+		// do something here while override this function
+	}
+}
 
+auto ppl::pipeline::run_for(std::size_t ticks) -> run_result {
+	auto active = active_run{*this};
+	auto start = std::chrono::steady_clock::now();
+	auto result = run_result{};
+	while (result.ticks < ticks && !result.closed){
+		result.closed = this->step();
+		++result.ticks;
+	}
+	result.elapsed = std::chrono::steady_clock::now() - start;
+	return result;
+}
 
-				if (node_status.at(next_n_id) != poll::closed){
-					node_status[next_n_id] = poll::empty;
-					skipped.insert(next_n_id);
-				}
+auto ppl::pipeline::run_until(std::chrono::steady_clock::time_point deadline) -> run_result {
+	// bounds how long a sudden slowdown can go unnoticed
+	constexpr auto max_batch = std::size_t{1024};
 
-				in_degree.at(next_n_id) -= 1;
-				if (in_degree.at(next_n_id) == 0){
-					Q.push(next_n_id);
-				}
+	auto active = active_run{*this};
+	auto start = std::chrono::steady_clock::now();
+	auto result = run_result{};
+	auto now = start;
+	auto batch = std::size_t{1};
+	while (!result.closed && now < deadline){
+		auto batch_start = now;
+		for (auto k = 0u; k < batch && !result.closed; ++k){
+			result.closed = this->step();
+			++result.ticks;
+		}
+		now = std::chrono::steady_clock::now();
+
+		// aim the next batch at half of the remaining time, at the rate just measured
+		auto per_tick = (now - batch_start).count() / static_cast<std::chrono::steady_clock::rep>(batch);
+		if (per_tick <= 0){
+			batch = std::min(batch * 2, max_batch);
+		}
+		else {
+			auto fits = (deadline - now).count() / (2 * per_tick);
+			batch = fits < 1 ? 1 : std::min(static_cast<std::size_t>(fits), max_batch);
+		}
+	}
+	result.elapsed = now - start;
+	return result;
+}
+
+auto ppl::pipeline::run_budget(std::chrono::steady_clock::duration budget) -> run_result {
+	return this->run_until(std::chrono::steady_clock::now() + budget);
+}
+
+// Every edge becomes a bounded queue and every node a stage that repeatedly takes one token from each input, polls
+// the node if they are all ready, and pushes the outcome to each output. Every node emits exactly one token per output
+// per tick, so queues along different paths stay in step and bounded capacity cannot deadlock a diamond.
+// The plan's units are dealt out in order to at most as many threads as workers, the calling thread included, and each
+// thread ticks its stages in plan order. Every thread then works through (tick, plan position) in increasing order, so
+// the earliest stage still to run only waits on stages that have already run and some thread can always progress.
+// A node stops once it is closed or once all of its dependents have stopped; it then abandons its inputs, so demand
+// unwinds upstream and run() returns when every stage has stopped.
+void ppl::pipeline::run_streaming() {
+	auto& plan = this->plan_;
+	auto n = plan.nodes.size();
 
+	// one channel per edge, in plan input order
+	std::vector<std::unique_ptr<internal::stream_channel>> channels(plan.inputs.size());
+	std::vector<std::vector<internal::stream_channel*>> outputs(n);
+	for (auto i = 0u; i < n; ++i){
+		for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+			auto make_channel = plan.make_stream_channel[plan.inputs[j]];
+			if (make_channel == nullptr){
+				throw std::runtime_error("streaming requires copyable node outputs");
 			}
+			channels[j] = make_channel(this->options_.queue_capacity);
+			outputs[plan.inputs[j]].push_back(channels[j].get());
+		}
+	}
 
-		} else if (cur_poll == poll::ready){
+	// point every consumer at its channels for the duration of the run
+	auto rewire = [&](bool to_channels) {
+		for (auto i = 0u; i < n; ++i){
+			for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+				auto source = to_channels ? channels[j]->reader() : plan.input_nodes[j];
+				plan.nodes[i]->connect(source, static_cast<int>(j - plan.input_offsets[i]));
+			}
+		}
+	};
+	struct restore_wiring {
+		decltype(rewire)& f;
+		~restore_wiring() {
+			f(false);
+		}
+	};
+	rewire(true);
+	auto restore = restore_wiring{rewire};
 
-			auto cons = this->get_dependencies(cur_n_id);
-			for (auto& [next_n_id, _]: cons){
+	// each stage only ever records into its own node's counters and trace buffer
+	auto instrumented = this->options_.collect_stats || this->trace_ != nullptr;
+	auto run_start = std::chrono::steady_clock::now();
 
-//				auto next_node = this->nodes_.at(next_n_id).get();
-				if (node_status.at(next_n_id) != poll::closed && skipped.count(next_n_id) == 0){
-					node_status[next_n_id] = poll::ready;
+	std::mutex error_mutex{};
+	std::exception_ptr error{};
+	std::atomic<bool> stopping{false}; // closes every source, to wind the run down after an error
+	// one tick of node i; returns false once the node has stopped
+	auto stage = [&](std::size_t i) -> bool {
+		auto first = plan.input_offsets[i];
+		auto last = plan.input_offsets[i + 1];
+		// with a single output channel, nothing but that channel reads the value after this tick's poll
+		auto take_output = outputs[i].size() == 1;
+		auto status = first == last && stopping.load(std::memory_order_relaxed) ? poll::closed : poll::ready;
+		auto live = true;
+		try {
+			// a closed input closes this node, otherwise an empty input skips it
+			for (auto j = first; j < last; ++j){
+				auto in = channels[j]->wait();
+				if (in == poll::closed){
+					status = poll::closed;
 				}
-
-				in_degree.at(next_n_id) -= 1;
-				if (in_degree.at(next_n_id) == 0){
-					Q.push(next_n_id);
+				else if (in == poll::empty && status != poll::closed){
+					status = poll::empty;
+				}
+			}
+			auto polled = status == poll::ready;
+			if (status == poll::ready && instrumented){
+				auto start = std::chrono::steady_clock::now();
+				status = plan.nodes[i]->poll_next();
+				auto end = std::chrono::steady_clock::now();
+				if (this->options_.collect_stats){
+					record_poll(*plan.stats[i], status, end - start);
 				}
+				if (this->trace_ != nullptr){
+					plan.trace_events[i].push_back({this->trace_->since_start(start),
+					                                this->trace_->since_start(end),
+					                                internal::trace_thread_id(),
+					                                status});
+				}
+			}
+			else if (status == poll::ready){
+				status = plan.nodes[i]->poll_next();
+			}
+			if (polled && status == poll::closed && plan.is_sink[i]){
+				plan.closed[i]->store(true, std::memory_order_relaxed);
 			}
 
-		} else {
-			throw std::runtime_error("node poll_next() return invalid value");
+			live = outputs[i].empty();
+			for (auto* out : outputs[i]){
+				live = out->push(*plan.nodes[i], status, take_output) || live;
+			}
+			for (auto j = first; j < last; ++j){
+				channels[j]->pop();
+			}
+		} catch (...) {
+			{
+				auto lock = std::lock_guard{error_mutex};
+				if (!error){
+					error = std::current_exception();
+				}
+			}
+			// the run ends with the error, as a serial one would, rather than with whichever branches stay live
+			stopping.store(true, std::memory_order_relaxed);
+			for (auto* out : outputs[i]){
+				out->push(*plan.nodes[i], poll::closed, false);
+			}
+			status = poll::closed;
 		}
+		if (status != poll::closed && live){
+			return true;
+		}
+		// closed, or nobody downstream is listening any more
+		for (auto j = first; j < last; ++j){
+			channels[j]->abandon();
+		}
+		return false;
+	};
+	auto run_group = [&](std::size_t begin, std::size_t end) {
+		auto running = std::vector<std::size_t>(end - begin);
+		std::iota(running.begin(), running.end(), begin);
+		while (!running.empty()){
+			std::erase_if(running, [&](std::size_t i) { return !stage(i); });
+		}
+	};
 
-	}
-
-	for (auto& x: this->sinks_){
-		if (node_status.at(x) != poll::closed){
-			return false;
+	auto units = plan.unit_offsets.size() - 1;
+	auto groups = std::max(std::size_t{1}, std::min(worker_count(this->options_), units));
+	auto group_begin = [&](std::size_t g) {
+		return plan.unit_offsets[g * units / groups];
+	};
+	{
+		std::vector<std::jthread> threads{};
+		auto started = std::size_t{1};
+		try {
+			threads.reserve(groups - 1);
+			for (; started < groups; ++started){
+				threads.emplace_back(run_group, group_begin(started), group_begin(started + 1));
+			}
+		} catch (...) {
+			// The stages that will never run close their outputs and abandon their inputs in their place (each channel
+			// is empty and has no other user on that side), and every running source closes, so that each running
+			// stage stops before the threads are joined.
+			stopping.store(true, std::memory_order_relaxed);
+			auto never_run = [&](std::size_t i) {
+				return i < group_begin(1) || i >= group_begin(started);
+			};
+			for (auto i = 0u; i < n; ++i){
+				if (never_run(i)){
+					for (auto* out : outputs[i]){
+						out->push(*plan.nodes[i], poll::closed, false);
+					}
+					for (auto j = plan.input_offsets[i]; j < plan.input_offsets[i + 1]; ++j){
+						channels[j]->abandon();
+					}
+				}
+			}
+			throw;
 		}
+		run_group(group_begin(0), group_begin(1));
 	}
 
-	return true;
-}
-
-// Preconditions: is_valid() is true.
-// Run the pipeline until all sink nodes are closed. Equivalent to while(!step()) {}, but potentially more efficient.
-auto ppl::pipeline::run() -> void {
-	if (!this->is_valid()){
-		throw std::runtime_error("pipeline is not valid, no call for run()");
+	if (this->trace_ != nullptr){
+		this->trace_->span("streaming run", this->trace_->since_start(run_start),
+		                   this->trace_->since_start(std::chrono::steady_clock::now()));
+		this->drain_trace();
 	}
-	while (!this->step()){
-		// do something here while override this function
+	if (error){
+		std::rethrow_exception(error);
 	}
 }
 
@@ -365,25 +1394,106 @@ auto ppl::pipeline::run() -> void {
 // Preconditions: None.
 // Print a graphical representation of the pipeline dependency graph to the given output stream, according to the rules above.
 std::ostream& ppl::operator<<(std::ostream & os, ppl::pipeline const & p) {
+	auto lock = std::lock_guard{p.graph_mutex_};
 	os << "digraph G {" << std::endl;
-	std::set<ppl::pipeline::node_id> nodes_sorted{};
-	for (auto& [id, _]: p.nodes_){
-		nodes_sorted.insert(id);
+	p.print_graph(os, "", "  ", false);
+	os << "}" << std::endl;
+	return os;
+}
+
+void ppl::pipeline::print_clusters(std::ostream& os) const {
+	auto lock = std::lock_guard{this->graph_mutex_};
+	os << "digraph G {" << std::endl;
+	this->print_graph(os, "", "  ", true);
+	os << "}" << std::endl;
+}
+
+void ppl::pipeline::print_graph(std::ostream& os,
+                                const std::string& prefix,
+                                const std::string& indent,
+                                bool clusters) const {
+	std::vector<node_id> nodes_sorted{};
+	nodes_sorted.reserve(this->node_count_);
+	for (auto index = 0u; index < this->slots_.size(); ++index){
+		if (this->slots_[index].instance != nullptr){
+			nodes_sorted.push_back(make_id(index, this->slots_[index].generation));
+		}
 	}
+	// nodes are shown by creation number rather than by ID, which need not be sequential once slots are reused
+	auto serial_of = [this](node_id id) {
+		return this->slots_[slot_index_unchecked(id)].serial;
+	};
+	auto by_serial = [&serial_of](node_id a, node_id b) {
+		return serial_of(a) < serial_of(b);
+	};
+	std::sort(nodes_sorted.begin(), nodes_sorted.end(), by_serial);
+	auto name_of = [this](node_id id) {
+		return this->slots_[slot_index_unchecked(id)].instance->name();
+	};
 	for (auto& id: nodes_sorted){
-		os << "  \"" << id << " " << p.nodes_.at(id)->name() << "\"" << std::endl;
+		os << indent << "\"" << prefix << serial_of(id) << " " << name_of(id) << "\"" << std::endl;
 	}
 	os << std::endl;
 	for (auto& id: nodes_sorted){
-		auto cons_unsorted = p.get_dependencies(id);
-		std::set<ppl::pipeline::node_id> cons{};
-		for (auto& [next_id, _]: cons_unsorted){
-			cons.insert(next_id);
+		auto cons = std::vector<node_id>{};
+		for (auto& [next_id, _]: this->slots_[slot_index_unchecked(id)].dependents){
+			cons.push_back(next_id);
 		}
+		std::sort(cons.begin(), cons.end(), by_serial);
 		for (auto& next_id: cons){
-			os << "  \"" << id << " " << p.nodes_.at(id)->name() << "\" -> \"" << next_id << " " << p.nodes_.at(next_id)->name() << "\"" << std::endl;
+			os << indent << "\"" << prefix << serial_of(id) << " " << name_of(id) << "\" -> \"" << prefix
+			   << serial_of(next_id) << " " << name_of(next_id) << "\"" << std::endl;
 		}
 	}
-	os << "}" << std::endl;
-	return os;
+	if (!clusters){
+		return;
+	}
+	for (auto& id: nodes_sorted){
+		if (auto* parts = this->slots_[slot_index_unchecked(id)].instance->as_composite()){
+			auto inner = prefix + std::to_string(serial_of(id)) + ".";
+			os << indent << "subgraph \"cluster_" << prefix << serial_of(id) << "\" {" << std::endl;
+			os << indent << "  label=\"" << prefix << serial_of(id) << " " << name_of(id) << "\"" << std::endl;
+			parts->fragment->print_graph(os, inner, indent + "  ", true);
+			os << indent << "}" << std::endl;
+		}
+	}
+}
+
+
+// bulk construction
+
+void ppl::pipeline_builder::commit(pipeline& target) {
+	// everything below happens on the staged graph, so target is only touched by the final noexcept swap
+	auto staged = std::exchange(this->staged_, pipeline{this->staged_.resource_});
+	auto edges = std::exchange(this->edges_, {});
+	auto& slots = staged.slots_;
+
+	// size every dependent list once instead of growing it edge by edge
+	std::vector<std::size_t> fan_out(slots.size(), 0);
+	for (auto& edge : edges){
+		++fan_out[staged.slot_index(edge.src)];
+	}
+	for (auto index = 0u; index < slots.size(); ++index){
+		slots[index].dependents.reserve(fan_out[index]);
+	}
+
+	for (auto& [src, dst, slot] : edges){
+		staged.add_edge(src, dst, slot);
+	}
+
+	// account for all edges at once; is_valid() then counts components and orders the nodes in one pass each
+	staged.unfilled_slots_ -= edges.size();
+	staged.dangling_nodes_ = 0;
+	for (auto& slot_n : slots){
+		staged.dangling_nodes_ += slot_n.instance != nullptr && !slot_n.is_sink && slot_n.dependents.empty();
+	}
+	staged.components_dirty_ = true;
+	staged.order_dirty_ = true;
+	if (!staged.is_valid()){
+		throw std::runtime_error("pipeline_builder: the staged graph is not valid");
+	}
+	staged.options_ = target.options_;
+	staged.compile_plan();
+
+	target.take_graph(staged);
 }
@@ -5,11 +5,17 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <queue>
 #include <set>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -17,6 +23,12 @@
 #include <vector>
 #include <typeindex>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+
+#include "./shared_value.h"
+#include "./spsc_queue.h"
 
 namespace ppl {
 	
@@ -42,6 +54,25 @@ namespace ppl {
 		[[nodiscard]] const char* what() const noexcept override;
 	};
 
+	template<typename Output>
+	struct producer;
+
+	namespace internal {
+		// Stands in for the batch element type of components that do not have exactly one input.
+		struct no_batch {};
+
+		// One producer pointer per input slot of a component, typed by the slot.
+		template<typename Input>
+		struct input_slots;
+
+		template<typename... Ts>
+		struct input_slots<std::tuple<Ts...>> {
+			using type = std::tuple<const producer<Ts>*...>;
+		};
+
+		struct composite_parts;
+	} // namespace internal
+
 	template <typename Input, std::size_t... Is>
 	[[nodiscard]] auto create_types_array(std::index_sequence<Is...>) {
 		return std::array<std::type_index, sizeof...(Is)>{std::type_index(typeid(std::tuple_element_t<Is, Input>))...};
@@ -65,6 +96,13 @@ namespace ppl {
 		closed,
 	};
 
+	template<typename Nodes, typename... Edges>
+	class static_pipeline;
+	class pipeline;
+	class snapshot_registry;
+	template<typename Input, typename Output>
+	class composite;
+
 	class node {
 	 public:
 		[[nodiscard]] virtual auto name() const -> std::string = 0;
@@ -83,7 +121,31 @@ namespace ppl {
 
 		// virtual auto set_poll(poll p) -> void;
 
+		// Type-erased batch support, see producer::poll_batch() and component::consume_batch().
+		[[nodiscard]] virtual auto batch_output() const -> bool {
+			return false;
+		}
+		[[nodiscard]] virtual auto batch_input() const -> bool {
+			return false;
+		}
+		virtual auto poll_batch_erased([[maybe_unused]] std::size_t max) -> poll {
+			return this->poll_next();
+		}
+		virtual auto consume_batch_erased([[maybe_unused]] const node& source) -> poll {
+			return this->poll_next();
+		}
+		// Tells a component whether it is the only consumer of the producer in input slot, see component::take().
+		virtual void set_exclusive_input([[maybe_unused]] int slot, [[maybe_unused]] bool exclusive) {}
+		// The fragment a composite is made of, or nullptr for any other node.
+		[[nodiscard]] virtual auto as_composite() const -> const internal::composite_parts* {
+			return nullptr;
+		}
+
 		friend class pipeline;
+		template<typename Nodes, typename... Edges>
+		friend class static_pipeline;
+		template<typename Input, typename Output>
+		friend class composite;
 	};
 
 	// producer
@@ -95,6 +157,52 @@ namespace ppl {
 		// you must specialise the producer type for when Output is void.
 		virtual auto value() const -> const output_type& = 0; // only when `Output` is not `void`
 		// when `Output` is `void`, this function does not exist
+
+		// Optional batch interface. A producer that returns true from supports_batch() may be polled with
+		// poll_batch() instead of poll_next(): it prepares up to max values at once and returns poll::ready with them
+		// in batch() (or poll::empty / poll::closed as poll_next() would). The pipeline only does so when the single
+		// dependent of this producer consumes batches too; every other edge still uses poll_next() and value().
+		[[nodiscard]] virtual auto supports_batch() const -> bool {
+			return false;
+		}
+		virtual auto poll_batch([[maybe_unused]] std::size_t max) -> poll {
+			return poll::closed;
+		}
+		[[nodiscard]] virtual auto batch() const -> std::span<const output_type> {
+			return {};
+		}
+
+		// Hands the current value over to this producer's only consumer (see component::take()), leaving it in a
+		// valid but unspecified state until the next poll. Override to move out of expensive values; the default
+		// copies value().
+		virtual auto take_value() -> output_type {
+			if constexpr (std::is_copy_constructible_v<output_type>) {
+				return this->value();
+			}
+			else {
+				throw std::logic_error("producer::take_value() must be overridden for move-only outputs");
+			}
+		}
+
+		// A handle on the current value that consumers may keep past this tick (see component::share()).
+		// Producers that feed many dependents should hold their value in a shared_value and return it here, so that
+		// every consumer retains the same value instead of its own copy; the default copies value().
+		[[nodiscard]] virtual auto shared() const -> shared_value<output_type> {
+			if constexpr (std::is_copy_constructible_v<output_type>) {
+				return shared_value<output_type>(this->value());
+			}
+			else {
+				throw std::logic_error("producer::shared() must be overridden for move-only outputs");
+			}
+		}
+
+	 private:
+		[[nodiscard]] auto batch_output() const -> bool final {
+			return this->supports_batch();
+		}
+		auto poll_batch_erased(std::size_t max) -> poll final {
+			return this->poll_batch(max);
+		}
 	};
 
 	template<>
@@ -108,11 +216,39 @@ namespace ppl {
 	struct component : producer<Output> {
 		using input_type = Input;
 		using output_type = Output;
-		input_type input_;
-		poll poll_status_ = poll::empty;
 
-		// Returns: The number of input slots this component has.
+		// The value of the producer connected to slot I, without any cast on the caller's side. Meant for poll_next(),
+		// which the pipeline only calls once every input is ready. Requires the default connect() below to be in use.
+		template<std::size_t I>
+		[[nodiscard]] auto input() const -> const std::tuple_element_t<I, input_type>& {
+			return std::get<I>(this->inputs_)->value();
+		}
+
+		// Like input<I>(), but hands the value over: moved out of the producer (see producer::take_value()) when this
+		// component is its only consumer, so nothing else can observe the moved-from value, and copied otherwise.
+		// Take each slot at most once per poll.
+		template<std::size_t I>
+		[[nodiscard]] auto take() -> std::tuple_element_t<I, input_type> {
+			auto* source = std::get<I>(this->inputs_);
+			if (this->exclusive_inputs_[I]) {
+				// producers are never const; the slot only holds a read-only view of them
+				return const_cast<producer<std::tuple_element_t<I, input_type>>*>(source)->take_value();
+			}
+			return source->value();
+		}
+
+		// A handle on the value of slot I that may be kept beyond this poll, see producer::shared().
+		// Mutating it through shared_value::mutate() copies the value first, so the other consumers never see it.
+		template<std::size_t I>
+		[[nodiscard]] auto share() const -> shared_value<std::tuple_element_t<I, input_type>> {
+			return std::get<I>(this->inputs_)->shared();
+		}
 
+		// The producer connected to slot I, or nullptr while the slot is unconnected.
+		template<std::size_t I>
+		[[nodiscard]] auto input_source() const -> const producer<std::tuple_element_t<I, input_type>>* {
+			return std::get<I>(this->inputs_);
+		}
 
 		// self-defined
 		auto get_output_type() const -> const std::type_index override {
@@ -122,6 +258,9 @@ namespace ppl {
 //
 		auto get_input_type(const int slot) const -> const std::type_index override {
 			auto& array = input_types<input_type>();
+			if (slot < 0 || static_cast<std::size_t>(slot) >= array.size()) {
+				throw pipeline_error(pipeline_error_kind::no_such_slot);
+			}
 			return array[static_cast<std::size_t>(slot)];
 		}
 
@@ -136,24 +275,59 @@ namespace ppl {
 		// A later call to connect with a non-null pointer will later fill that slot again.
 		// Preconditions: slot is a valid index, and source is either a pointer to a producer of the correct type, or
 		// nullptr.
-
-		auto connect([[maybe_unused]]const node* source, [[maybe_unused]]const int slot) -> void override {
-//			if (slot < 0 || slot >= static_cast<int>(std::tuple_size_v<input_type>)) {
-//				throw pipeline_error(pipeline_error_kind::no_such_slot);
-//			}
-//			if (source == nullptr) {
-//				// std::get<slot>(input_) = nullptr;
-//			} else {
-//				// erase node type and assign it to the type of slot-th input slot
-//				using slot_type = std::remove_reference_t<decltype(std::get<slot>(input_))>;
-//				auto src_node_ptr = std::forward<producer<slot_type>*>(source);
-//				std::get<slot>(input_) = src_node_ptr.value();
-//			}
+		// By default the producer is kept in the typed slot read by input<I>(), so components need not override this.
+		auto connect(const node* source, const int slot) -> void override {
+			this->bind_input(source, slot, std::make_index_sequence<std::tuple_size_v<input_type>>{});
 		}
 
 		[[nodiscard]]auto name() const -> std::string override {
 			return "node: "+std::to_string(reinterpret_cast<std::uintptr_t>(this));
 		}
+
+		// Optional batch interface for components with exactly one input slot. A component that returns true from
+		// accepts_batch() is handed its producer's whole batch() at once instead of being polled per value, whenever
+		// that producer supports batches and this component is its only dependent. The result is this component's
+		// poll status for the tick, as if from poll_next().
+		using batch_value_type =
+		   std::tuple_element_t<0, std::conditional_t<std::tuple_size_v<Input> == 1, Input, std::tuple<internal::no_batch>>>;
+		[[nodiscard]] virtual auto accepts_batch() const -> bool {
+			return false;
+		}
+		virtual auto consume_batch([[maybe_unused]] std::span<const batch_value_type> values) -> poll {
+			return poll::closed;
+		}
+
+	 private:
+		template<std::size_t... Is>
+		void bind_input([[maybe_unused]] const node* source, [[maybe_unused]] int slot, std::index_sequence<Is...>) {
+			// the pipeline has already checked that source produces the slot's type
+			((slot == static_cast<int>(Is)
+			     ? void(std::get<Is>(this->inputs_) =
+			               static_cast<const producer<std::tuple_element_t<Is, input_type>>*>(source))
+			     : void()),
+			 ...);
+		}
+
+		void set_exclusive_input(int slot, bool exclusive) final {
+			if constexpr (std::tuple_size_v<input_type> != 0) {
+				this->exclusive_inputs_[static_cast<std::size_t>(slot)] = exclusive;
+			}
+		}
+
+		[[nodiscard]] auto batch_input() const -> bool final {
+			return std::tuple_size_v<Input> == 1 && this->accepts_batch();
+		}
+		auto consume_batch_erased(const node& source) -> poll final {
+			if constexpr (std::tuple_size_v<Input> == 1) {
+				return this->consume_batch(static_cast<const producer<batch_value_type>&>(source).batch());
+			}
+			else {
+				return poll::closed;
+			}
+		}
+
+		typename internal::input_slots<input_type>::type inputs_{};
+		std::array<bool, std::tuple_size_v<input_type>> exclusive_inputs_{};
 	};
 
 	// sink & source
@@ -194,18 +368,226 @@ namespace ppl {
 
 
 
+	namespace internal {
+		class worker_pool;
+		class task_scheduler;
+		class trace_writer;
+
+		// One poll, recorded while tracing (see pipeline::start_trace()). Times are trace_writer::since_start().
+		struct trace_event {
+			std::int64_t start;
+			std::int64_t end;
+			std::uint32_t thread;
+			poll status;
+		};
+		// A small number naming the calling thread in traces.
+		auto trace_thread_id() -> std::uint32_t;
+
+		// One edge of a streaming run: the values a producer emitted, tick by tick, waiting for one consumer slot.
+		// The pipeline pushes from the producer's thread and reads from the consumer's thread.
+		class stream_channel {
+		 public:
+			virtual ~stream_channel() = default;
+			// A producer of the same output type whose value() is the token at the front of the channel.
+			// The consumer is connected to this in place of the real producer for the duration of the run.
+			[[nodiscard]] virtual auto reader() const -> const node* = 0;
+			// Enqueues status, with the producer's value when it is poll::ready: taken (see producer::take_value())
+			// when take is set, because this channel is the producer's only output, and copied otherwise.
+			// Blocks while the channel is full; returns false once the consumer has abandoned it.
+			virtual auto push(node& source, poll status, bool take) -> bool = 0;
+			// Blocks until the next token arrives and returns its status.
+			virtual auto wait() -> poll = 0;
+			virtual void pop() = 0;
+			virtual void abandon() = 0;
+			[[nodiscard]] virtual auto abandoned() const -> bool = 0;
+		};
+
+		template<typename Output>
+		class typed_stream_channel final : public stream_channel {
+		 public:
+			explicit typed_stream_channel(std::size_t capacity)
+			: queue_(capacity) {}
+
+			[[nodiscard]] auto reader() const -> const node* override {
+				return &this->reader_;
+			}
+			auto push(node& source, poll status, bool take) -> bool override {
+				if (status == poll::ready){
+					auto& producer_x = static_cast<producer<Output>&>(source);
+					if (take){
+						return this->queue_.push(token{status, producer_x.take_value()});
+					}
+					return this->queue_.push(token{status, producer_x.value()});
+				}
+				return this->queue_.push(token{status, std::nullopt});
+			}
+			auto wait() -> poll override {
+				return this->queue_.front().status;
+			}
+			void pop() override {
+				this->queue_.pop();
+			}
+			void abandon() override {
+				this->queue_.abandon();
+			}
+			[[nodiscard]] auto abandoned() const -> bool override {
+				return this->queue_.abandoned();
+			}
+
+		 private:
+			struct token {
+				poll status = poll::empty;
+				std::optional<Output> value{};
+			};
+
+			struct stream_reader final : source<Output> {
+				explicit stream_reader(typed_stream_channel& channel)
+				: channel_(channel) {}
+				[[nodiscard]] auto name() const -> std::string override {
+					return "stream";
+				}
+				auto poll_next() -> poll override {
+					return poll::ready;
+				}
+				auto value() const -> const Output& override {
+					return *this->channel_.queue_.front().value;
+				}
+				// the token is popped once its consumer has been polled, so nobody else sees it
+				auto take_value() -> Output override {
+					return std::move(*this->channel_.queue_.front().value);
+				}
+
+			 private:
+				typed_stream_channel& channel_;
+			};
+
+			spsc_queue<token> queue_;
+			stream_reader reader_{*this};
+		};
+
+		// Owner of a node made by pipeline::create_node: destroys it and returns its storage to the memory resource it
+		// was allocated from (storage is kept separately, as the node base need not sit at the start of the object).
+		struct node_deleter {
+			std::pmr::memory_resource* resource = nullptr;
+			void* storage = nullptr;
+			std::size_t size = 0;
+			std::size_t alignment = 0;
+
+			void operator()(node* n) const noexcept {
+				n->~node();
+				this->resource->deallocate(this->storage, this->size, this->alignment);
+			}
+		};
+
+		// Stored per node by create_node, so that the type-erased pipeline can build channels for its outputs.
+		// Sinks and nodes whose output cannot be copied have none and cannot take part in a streaming run.
+		template<typename Output>
+		auto make_stream_channel(std::size_t capacity) -> std::unique_ptr<stream_channel> {
+			return std::make_unique<typed_stream_channel<Output>>(capacity);
+		}
+	} // namespace internal
+
+	// How a pipeline executes its ticks.
+	enum class execution_mode {
+		// Every node is polled on the calling thread.
+		serial,
+		// Nodes are grouped by topological depth; each group is polled on a worker pool, with a barrier between
+		// groups. Nodes may then be polled concurrently with other nodes of the same depth.
+		level_parallel,
+		// run() only: nodes are spread over the workers in runs of consecutive plan units, and consume their inputs
+		// from bounded queues, so nodes on different threads work on consecutive ticks at the same time. Outputs must
+		// be copyable. step() still runs serially.
+		streaming,
+		// Each node becomes a task as soon as all of its inputs have resolved for the current tick, and tasks are
+		// balanced over the workers by work stealing. Suits graphs where node costs vary widely.
+		work_stealing,
+	};
+
+	struct run_options {
+		execution_mode mode = execution_mode::serial;
+		// Number of threads polling nodes, including the calling thread. 0 picks the hardware concurrency.
+		std::size_t workers = 0;
+		// streaming: how many ticks a node may run ahead of each of its dependents.
+		std::size_t queue_capacity = 64;
+		// work_stealing: bind each spawned worker thread to its own CPU. The calling thread is left as it is.
+		bool pin_workers = false;
+		// Most values a batching producer may prepare per tick (see producer::poll_batch()). 0 disables batching.
+		std::size_t batch_size = 256;
+		// Run each linear chain of single-input nodes, whose producers feed nothing else, as one scheduling unit.
+		bool fuse_chains = true;
+		// Count and time every poll into per-node node_stats (see pipeline::stats()).
+		bool collect_stats = false;
+	};
+
+	// Counters for one node, collected while run_options::collect_stats is set.
+	// Only actual polls count: a node skipped because an input was empty or closed is not polled.
+	struct node_stats {
+		std::uint64_t polls = 0;
+		std::uint64_t ready = 0;
+		std::uint64_t empty = 0;
+		std::uint64_t closed = 0;
+		// Time spent in poll_next() (or poll_batch() / consume_batch()), by steady_clock: latency_histogram[b] counts
+		// polls that took less than 2^b ns but at least 2^(b-1) ns, and the last bucket everything slower.
+		std::array<std::uint64_t, 32> latency_histogram{};
+		std::chrono::nanoseconds total_latency{};
+	};
+
+	// What a bounded run (pipeline::run_for(), run_until(), run_budget()) got done before returning.
+	struct run_result {
+		// Calls to step() made.
+		std::size_t ticks = 0;
+		// Whether the last of them reported every sink closed, i.e. a further run() would be a no-op.
+		bool closed = false;
+		std::chrono::steady_clock::duration elapsed{};
+	};
+
 	class pipeline {
 	 public:
 		// 3.6.1
-		using node_id = std::uint16_t;
+		// A generational handle: the low 32 bits are the storage slot plus one, the high 32 bits count how many times
+		// that slot has been reused. IDs therefore start at 1 and count up until a node is erased, and an ID that
+		// outlives its node is detected instead of silently naming whatever reuses the slot.
+		using node_id = std::uint64_t;
 
 		// 3.6.2
 		pipeline();
+		// Nodes and their per-node edge lists are allocated from resource, e.g. a std::pmr::monotonic_buffer_resource
+		// to build a large graph with a handful of allocations and keep its nodes contiguous. The resource must
+		// outlive the pipeline, and moving from the pipeline hands it over with the nodes. The pipeline only uses it
+		// while holding its lock, so it need not be thread-safe even when nodes are created during a run.
+		explicit pipeline(std::pmr::memory_resource* resource);
 		pipeline(const pipeline&) = delete;
 		pipeline(pipeline&&) noexcept;
 		auto operator=(const pipeline&) -> pipeline& = delete;
 		auto operator=(pipeline&&) noexcept -> pipeline&;
-		~pipeline() = default;
+		~pipeline();
+
+		// Hot reconfiguration: create_node, erase_node, connect and disconnect, and the read-only get_node,
+		// get_dependencies, is_valid, operator<< and print_clusters, may be called from any thread, including while
+		// run(), run_for(), run_until() or run_budget() is executing on another. The run keeps ticking its current
+		// execution plan, whose nodes and wiring these calls leave alone; at the first tick boundary at which the graph
+		// is valid again, it compiles a plan for the new graph, rewires the nodes to match and swaps it in. Each call
+		// is applied on its own, so a tick may run any valid graph left between two calls; to make a change of several
+		// calls take effect at once, make them while holding reconfigure(). Nodes erased meanwhile are only destroyed
+		// after the swap, when no tick can still poll them. A streaming run has no tick boundaries and does not apply
+		// changes while it runs: they take effect when it returns. Nothing else is synchronised with a run:
+		// set_options, start_trace, stop_trace, stats, reset_stats, the snapshot functions and pipeline_builder's
+		// commit and take_graph must wait until it has returned. A node returned by get_node may be polled by the run
+		// at any time, so using it is up to the node.
+
+		// Holds off the plan swap for as long as it lives, so that the calls made meanwhile reach a running pipeline
+		// together. Guards may be held from several threads at once; the swap waits for the last of them.
+		class reconfiguration {
+		 public:
+			explicit reconfiguration(pipeline& p);
+			reconfiguration(const reconfiguration&) = delete;
+			auto operator=(const reconfiguration&) -> reconfiguration& = delete;
+			~reconfiguration();
+
+		 private:
+			pipeline& p_;
+		};
+		[[nodiscard]] auto reconfigure() -> reconfiguration;
 
 		// 3.6.3
 		template<typename N, typename... Args>
@@ -213,172 +595,109 @@ namespace ppl {
 		//		             and std::constructible_from<N, Args...>
 		auto create_node(Args&&... args) -> node_id {
 			using input_type = typename N::input_type;
-//			using output_type = typename N::output_type;
-
-			// create a new node
-			auto node_x = std::make_unique<N>(std::forward<Args>(args)...);
-
-			auto id_x = this->next_id_++; // increase next_id_ after use the old value
-
-			if (this->nodes_.count(id_x) != 0) {
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::slot_already_used);
-			}
-			this->nodes_.insert({id_x, std::move(node_x)});
-
-			// if source node
-			if (std::is_same_v<input_type, std::tuple<>>) {
-				this->sources_.insert(id_x);
 
+			// resource_ need not be thread-safe, so even the node's storage is only taken under the lock
+			auto lock = std::lock_guard{this->graph_mutex_};
+			// create a new node before touching any state, so a throwing constructor leaves the pipeline unchanged
+			auto* storage = this->resource_->allocate(sizeof(N), alignof(N));
+			auto* created = static_cast<N*>(nullptr);
+			try {
+				created = std::construct_at(static_cast<N*>(storage), std::forward<Args>(args)...);
+			} catch (...) {
+				this->resource_->deallocate(storage, sizeof(N), alignof(N));
+				throw;
 			}
-
-			// if sink node
-			if (std::is_same_v<typename N::output_type, void>) {
-				this->sinks_.insert(id_x);
-
-			}
-
-			// get the tuple size of input_type
-//			auto x = node_x.get().get_all_input_type_idx();
-			auto input_type_id = input_types<input_type>();
-			std::vector<std::type_index> input_id_vec (input_type_id.begin(),input_type_id.end());
-			auto s = input_id_vec.size();
-
-			// initialize connections_ with size of input_type
-			if (s == 0) {
-				this->connections_[id_x] = std::vector<node_id>{};
-				this->sources_.insert(id_x);
+			auto node_x = std::unique_ptr<node, internal::node_deleter>(
+			   created, internal::node_deleter{this->resource_, storage, sizeof(N), alignof(N)});
+
+			auto index = this->allocate_slot();
+			auto& slot_x = this->slots_[index];
+			slot_x.instance = std::move(node_x);
+			slot_x.serial = ++this->created_;
+			slot_x.is_source = std::tuple_size_v<input_type> == 0;
+			slot_x.is_sink = std::is_same_v<typename N::output_type, void>;
+			// every slot starts out unconnected
+			slot_x.inputs.assign(std::tuple_size_v<input_type>, no_node);
+			if constexpr (std::is_copy_constructible_v<typename N::output_type>) {
+				slot_x.make_stream_channel = &internal::make_stream_channel<typename N::output_type>;
 			}
 			else {
-				this->connections_[id_x] = std::vector<node_id>(s, id_x);
+				slot_x.make_stream_channel = nullptr;
 			}
-			//	 Note: if connections_[id][x] = id, then the current slot x is not connected to any node
 
-			return id_x;
+			this->validity_on_create(index);
+			this->plan_dirty_ = true;
+			return make_id(index, slot_x.generation);
 		}
 
 		void erase_node(node_id n_id){
-			if (this->nodes_.count(n_id) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-//				return ;
+			auto lock = std::lock_guard{this->graph_mutex_};
+			auto index = this->slot_index(n_id);
+			auto& slot_n = this->slots_[index];
+			this->validity_on_erase(index);
+
+			// remove all connections: reset the slots fed by this node ...
+			for (auto& [dst_id, slot] : slot_n.dependents){
+				if (dst_id == n_id){
+					continue;
+				}
+				auto& dst = this->slots_[slot_index_unchecked(dst_id)];
+				dst.inputs[static_cast<std::size_t>(slot)] = no_node;
+				this->wire(dst, nullptr, slot);
 			}
-
-			nodes_[n_id] = nullptr;	// release memory
-
-			// remove all connections
-			this->nodes_.erase(n_id);
-			this->connections_.erase(n_id);
-			for (auto& [id, conn] : this->connections_){
-				for (auto& con_id : conn){	// traverse all slots
-					if (con_id == n_id){
-						con_id = id;	// reset the slot
-						// break;
-					}
+			// ... and forget this node as a dependent of its inputs
+			for (auto slot = 0u; slot < slot_n.inputs.size(); ++slot){
+				if (slot_n.inputs[slot] != no_node && slot_n.inputs[slot] != n_id){
+					this->remove_dependent(slot_n.inputs[slot], n_id, static_cast<int>(slot));
 				}
 			}
 
-			// remove from sources_ and sinks_
-			this->sources_.erase(n_id);
-			this->sinks_.erase(n_id);
+			this->release_slot(index);
+			this->plan_dirty_ = true;
 		}
 
 		[[nodiscard]]auto get_node(node_id n_id) const -> node*{
-			if (this->nodes_.count(n_id) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-				// return nullptr;
-			}
-			return this->nodes_.at(n_id).get();
+			auto lock = std::lock_guard{this->graph_mutex_};
+			return this->slots_[this->slot_index(n_id)].instance.get();
 		};
 		[[nodiscard]] auto get_node(node_id n_id) -> node*{
-			if (this->nodes_.count(n_id) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-				// return nullptr;
-			}
-			return this->nodes_.at(n_id).get();
+			auto lock = std::lock_guard{this->graph_mutex_};
+			return this->slots_[this->slot_index(n_id)].instance.get();
 		}
 
 		// 3.6.4
 		void connect(const node_id src_id, const node_id dst_id, const int slot){
-			// if src is sink or dst is source, throw error
-			if (this->sinks_.count(src_id) || this->sources_.count(dst_id)){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-			}
-
-			if (this->nodes_.count(src_id) == 0 || this->nodes_.count(dst_id) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-			}
-
-			auto src_node = get_node(src_id);
-			auto dst_node = get_node(dst_id);
-
-
-			if (this->connections_[dst_id][static_cast<std::size_t>(slot)] != dst_id){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::slot_already_used);
-			}
-			if (static_cast<std::size_t>(slot) >= this->connections_[dst_id].size()){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::no_such_slot);
-			}
-
-			// type mismatching
-			auto src_out = src_node->get_output_type();
-			auto dst_in = dst_node->get_input_type(slot);
-			if (src_out != dst_in){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::connection_type_mismatch);
-			}
-
-			// node.connect usage need to be done here
-			dst_node->connect(src_node, slot);
-
-			this->connections_[dst_id].at(static_cast<std::size_t>(slot)) = src_id;
-
-			// no need to change source/sink status since they are different class to component
-
+			auto lock = std::lock_guard{this->graph_mutex_};
+			this->add_edge(src_id, dst_id, slot);
+			this->validity_on_connect(slot_index_unchecked(src_id), slot_index_unchecked(dst_id));
+			this->plan_dirty_ = true;
 		}
 
 		void disconnect(const node_id src_id, const node_id dst_id){
-			if (this->nodes_.count(src_id) == 0 || this->nodes_.count(dst_id) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-			}
-
-			int s = -1;
-			for (auto slot = 0u; slot < this->connections_[dst_id].size(); ++slot){
-				if (this->connections_[dst_id].at(slot) == src_id){
-					this->connections_[dst_id].at(slot) = dst_id;	// reset
-					s = static_cast<int>(slot);
+			auto lock = std::lock_guard{this->graph_mutex_};
+			static_cast<void>(this->slot_index(src_id)); // validates src_id
+			auto& dst = this->slots_[this->slot_index(dst_id)];
+
+			for (auto slot = 0u; slot < dst.inputs.size(); ++slot){
+				if (dst.inputs[slot] == src_id){
+					dst.inputs[slot] = no_node;	// reset
+					this->remove_dependent(src_id, dst_id, static_cast<int>(slot));
+					this->validity_on_disconnect(slot_index_unchecked(src_id));
+					this->wire(dst, nullptr, static_cast<int>(slot));
+					this->plan_dirty_ = true;
 				}
 			}
-
-			if (s == -1){
-				//		throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-				return ;
-			}
-
-			//	auto src_node = get_node(src_id);
-			auto dst_node = get_node(dst_id);
-			dst_node->connect(nullptr, s);
 		}
 
 		auto get_dependencies(node_id src) const -> std::vector<std::pair<node_id, int>>{
-			if (this->nodes_.count(src) == 0){
-				throw ppl::pipeline_error(ppl::pipeline_error_kind::invalid_node_id);
-			}
-			std::vector<std::pair<node_id, int>> dependencies{};
-			if (this->sinks_.count(src)){
-				return dependencies;
-			}
-			for (const auto& [id, conn] : this->connections_){
-				if (id == src){
-					continue ;
-				}
-				for (auto i = 0u; i<conn.size();++i){
-					if (conn.at(i) == src){
-						dependencies.emplace_back( std::make_pair(id, static_cast<int>(i)) );
-					}
-				}
-			}
-			return dependencies;
+			auto lock = std::lock_guard{this->graph_mutex_};
+			auto& dependents = this->slots_[this->slot_index(src)].dependents;
+			return {dependents.begin(), dependents.end()};
 		}
 
 		// 3.6.5
+		// The validity conditions are tracked incrementally by the mutators above,
+		// so this is O(1) unless an edge or node was removed since the last call.
 		auto is_valid() -> bool;
 
 		// Preconditions: is_valid() is true.
@@ -390,6 +709,36 @@ namespace ppl {
 		// efficient.
 		void run();
 
+		// Preconditions: is_valid() is true.
+		// Bounded versions of run(), for sharing a thread with other work: each calls step() until every sink is
+		// closed or its bound is reached. run_for() stops after at most ticks ticks. run_until() and run_budget()
+		// stop at the first tick boundary past the deadline; they read the clock once per batch of ticks, sizing
+		// each batch from the tick rate measured so far, so a deadline is overrun by at most about one tick.
+		// Every mode steps tick by tick here, as step() does, including streaming.
+		auto run_for(std::size_t ticks) -> run_result;
+		auto run_until(std::chrono::steady_clock::time_point deadline) -> run_result;
+		auto run_budget(std::chrono::steady_clock::duration budget) -> run_result;
+
+		// Per-node counters collected since the node was created or reset_stats() was last called.
+		// stats() lists every node, sorted by ID. Throws invalid_node_id if id does not name a live node.
+		// The nodes inside a composite count their polls in the composite's fragment, see composite::fragment().
+		[[nodiscard]] auto stats(node_id id) const -> const node_stats&;
+		[[nodiscard]] auto stats() const -> std::vector<std::pair<node_id, node_stats>>;
+		void reset_stats() noexcept;
+
+		// Starts writing a Chrome trace-event JSON file to path, viewable in chrome://tracing or ui.perfetto.dev.
+		// Every tick becomes a span on the thread that called step() (a streaming run is one span), and every poll a
+		// slice on the thread that made it, labelled "id name" as in operator<< and carrying the poll result.
+		// Events are buffered and written out in large chunks. Replaces any trace already being written.
+		// Throws std::runtime_error if path cannot be opened.
+		void start_trace(const std::string& path);
+		// Completes the trace file. Happens anyway when the pipeline is destroyed.
+		void stop_trace();
+
+		// How step() and run() execute a tick. Takes effect from the next tick.
+		void set_options(const run_options& options);
+		[[nodiscard]] auto options() const noexcept -> const run_options&;
+
 		// 3.6.6
 		// We specify the output using the [Graphviz "DOT" language][http://graphviz.org/documentation/].
 		// Nodes are strings like "id name", where name is the result of a call to node::name() and id is a unique
@@ -421,16 +770,420 @@ namespace ppl {
 		// the rules above.
 		friend std::ostream& operator<<(std::ostream&, const pipeline&);
 
+		// Like operator<<, but every composite is followed by a cluster drawing its fragment, in which nodes are named
+		// "id.inner name": the composite's ID, then the node's ID within the fragment (and so on for composites within
+		// composites). Edges into and out of a composite still end at the composite's node.
+		void print_clusters(std::ostream& os) const;
+
+		friend class pipeline_builder;
+		template<typename Input, typename Output>
+		friend class composite;
+		friend void save_snapshot(std::ostream& os, const pipeline& p, const snapshot_registry& registry);
+		friend auto load_snapshot(std::span<const std::byte> data,
+		                          const snapshot_registry& registry,
+		                          std::pmr::memory_resource* resource) -> pipeline;
+
 	 private:
-		node_id next_id_;
-		std::unordered_map<node_id, std::unique_ptr<node>> nodes_;
-		std::unordered_map<node_id, std::vector<node_id>> connections_; // vector for slots (its local src_id)
-		std::unordered_set<node_id> sources_;
-		std::unordered_set<node_id> sinks_;
-		std::unordered_map<node_id, poll> node_status_{};
+		// Marks an unconnected input slot. Never a valid node_id, since the slot part of an ID starts at 1.
+		static constexpr node_id no_node = 0;
+
+		using stream_channel_factory = auto (*)(std::size_t) -> std::unique_ptr<internal::stream_channel>;
+		using node_ptr = std::unique_ptr<node, internal::node_deleter>;
+
+		// Storage for one node. Slots live contiguously in slots_ and are recycled through free_slots_;
+		// generation is bumped on every erase so that IDs handed out for the previous occupant go stale.
+		struct node_slot {
+			explicit node_slot(std::pmr::memory_resource* resource)
+			: inputs(resource)
+			, dependents(resource) {}
+
+			node_ptr instance{}; // null while the slot is free
+			std::uint32_t generation = 0;
+			bool is_source = false;
+			bool is_sink = false;
+			std::pmr::vector<node_id> inputs; // per input slot, the node feeding it or no_node
+			std::pmr::vector<std::pair<node_id, int>> dependents; // reverse of inputs: (dst, slot)
+			stream_channel_factory make_stream_channel = nullptr;
+			// the number operator<< shows for the node: which successful create_node call made it, counting from 1
+			std::uint64_t serial = 0;
+
+			// incrementally maintained validity state, see is_valid()
+			std::size_t component_parent = 0; // union-find over weakly connected components
+			std::size_t topo_order = 0; // a topological order while there is no cycle
+		};
+
+		// A flattened view of the graph, compiled once and reused by every tick until the graph is mutated.
+		// Entries are stored in topological order; inputs of entry i are the plan indices
+		// inputs[input_offsets[i] .. input_offsets[i + 1]), one per slot in slot order.
+		struct execution_plan {
+			std::vector<node*> nodes{};
+			// the serial of the node of this pipeline each entry is, or belongs to when it comes from a composite's
+			// fragment, which labels its polls in a trace as operator<< labels the node
+			std::vector<std::uint64_t> serials{};
+			std::vector<node_stats*> stats{}; // null unless stats are collected
+			// per sink, whether it closed itself; outlives the plan so that the next one keeps it dead
+			std::vector<std::atomic<bool>*> closed{};
+			std::vector<bool> is_sink{};
+			std::vector<stream_channel_factory> make_stream_channel{};
+			std::vector<std::size_t> input_offsets{};
+			std::vector<std::size_t> inputs{};
+			// per input, the node actually connected to the slot: a composite or placeholder rather than the entry
+			std::vector<node*> input_nodes{};
+			std::vector<std::size_t> sinks{};
+			// batch_edge[i]: entry i is polled with poll_batch() and its only dependent consumes the batch at once
+			std::vector<bool> batch_edge{};
+			// Entries are scheduled in units, each a linear chain fused into one task: unit u is the entries
+			// [unit_offsets[u], unit_offsets[u + 1]), and every entry after the first has the previous one as its
+			// only input and is its only dependent.
+			std::vector<std::size_t> unit_offsets{};
+			std::vector<std::size_t> unit_of{};
+			// units of level l are [level_offsets[l], level_offsets[l + 1]) and only depend on earlier levels
+			std::vector<std::size_t> level_offsets{};
+			// one entry per edge, dependents of entry i are dependents[dependent_offsets[i] .. dependent_offsets[i + 1])
+			std::vector<std::size_t> dependent_offsets{};
+			std::vector<std::size_t> dependents{};
+			std::vector<poll> status{}; // scratch space for the current tick
+			std::vector<std::atomic<std::size_t>> pending{}; // work_stealing: unresolved inputs per unit this tick
+			// while tracing, polls of each entry not yet handed to the trace writer
+			std::vector<std::vector<internal::trace_event>> trace_events{};
+
+			// Liveness, carried across ticks: an entry is dead once every sink downstream of it has closed,
+			// and dead entries are never polled again.
+			std::vector<bool> dead{};
+			std::vector<std::size_t> live_dependents{}; // dependent edges into entries that are not dead
+			std::size_t live_sinks = 0;
+		};
+
+		// The graph as it is executed, with every composite replaced by the nodes of its fragment, in topological
+		// order. Inputs of node i are inputs[input_offsets[i] .. input_offsets[i + 1]), one per slot.
+		struct flat_graph {
+			bool collect_stats = false; // whether the plan records polls into stats
+			std::vector<node*> nodes{};
+			std::vector<std::uint64_t> serials{};
+			std::vector<node_stats*> stats{};
+			// per sink, whether it closed itself; outlives the plan so that the next one keeps it dead
+			std::vector<std::atomic<bool>*> closed{};
+			std::vector<bool> is_sink{};
+			std::vector<stream_channel_factory> make_stream_channel{};
+			std::vector<std::size_t> input_offsets{0};
+			std::vector<std::size_t> inputs{};
+			std::vector<node*> input_nodes{};
+		};
+
+		static constexpr auto make_id(std::size_t index, std::uint32_t generation) noexcept -> node_id {
+			return (node_id{generation} << 32u) | (index + 1);
+		}
+		static constexpr auto slot_index_unchecked(node_id id) noexcept -> std::size_t {
+			return static_cast<std::size_t>((id & 0xffffffffu) - 1);
+		}
+		// Throws invalid_node_id unless id names a live node.
+		auto slot_index(node_id id) const -> std::size_t;
+		auto allocate_slot() -> std::size_t;
+		// Frees the slot, or retires its node while a run may still poll it.
+		void release_slot(std::size_t index);
+		// Destroys the retired nodes and frees their slots, once no plan in use refers to them.
+		void reclaim_retired();
+		// Connects source to slot of dst's node, or leaves that to the next plan swap while a run is active, and forgets
+		// that dst closed itself.
+		void wire(node_slot& dst, const node* source, int slot);
+
+		// Checks and records src_id -> dst_id at slot, throwing the errors described for connect(), without updating
+		// the validity state.
+		void add_edge(node_id src_id, node_id dst_id, int slot);
+		// Hands every node the producers its inputs record (and nullptr for unconnected slots), e.g. after restoring
+		// them from a snapshot. Only checks that the recorded IDs name nodes of this pipeline.
+		void connect_recorded_inputs();
+		// Moves the nodes, edges and execution plan of other into this pipeline, leaving other empty.
+		// Options, worker threads and tracing stay with each pipeline.
+		void take_graph(pipeline& other) noexcept;
+
+		// Whether src's output type is the type of dst's input slot.
+		static auto types_match(const node& src, const node& dst, int slot) -> bool {
+			return src.get_output_type() == dst.get_input_type(slot);
+		}
+		// Removes (dst_id, slot) from the dependents of src_id.
+		void remove_dependent(node_id src_id, node_id dst_id, int slot);
+
+		// Incremental bookkeeping for is_valid(), called by the mutators with slot indices.
+		void validity_on_create(std::size_t index);
+		void validity_on_erase(std::size_t index);
+		void validity_on_connect(std::size_t src, std::size_t dst);
+		void validity_on_disconnect(std::size_t src);
+
+		auto find_component(std::size_t index) -> std::size_t;
+		void recount_components();
+		// Pearce-Kelly: repairs the topological order after adding src -> dst, or records a cycle.
+		void reorder_after_connect(std::size_t src, std::size_t dst);
+		void recompute_order();
+		// Renumbers the order from 0 without gaps, keeping it as it is otherwise.
+		void compact_order();
+
+		// Sizes stats_ to the slots the first time stats are collected; slots added after that extend it.
+		void allocate_stats();
+		// Appends the nodes of this pipeline to flat, recursing into composites. Nodes are recorded under the serial
+		// of their owner, or under their own when it is 0. When this is a composite's fragment, its input placeholders
+		// are fed by the flat nodes fed_by, slot by slot; returns the flat node that output ends up as.
+		auto flatten(flat_graph& flat,
+		             std::uint64_t owner,
+		             std::span<node* const> placeholders,
+		             std::span<const std::size_t> fed_by,
+		             const node* output) -> std::size_t;
+		// Throws std::invalid_argument unless this graph can be the fragment of a composite: see composite.
+		void check_fragment(std::span<node* const> placeholders, const node* output);
+		// Validates the graph and rebuilds plan_ from the slots. The caller holds graph_mutex_, or owns the pipeline.
+		void compile_plan();
+		// is_valid() for a caller that holds graph_mutex_.
+		auto check_valid() -> bool;
+		// Replaces plan_ after the graph changed: see the hot reconfiguration notes above.
+		void update_plan();
+		// Marks a run in progress for the lifetime of the guard, so that mutators defer what would disturb it, and
+		// catches up with whatever they deferred when the run ends.
+		struct active_run {
+			explicit active_run(pipeline& p);
+			active_run(const active_run&) = delete;
+			auto operator=(const active_run&) -> active_run& = delete;
+			~active_run();
+			pipeline& p;
+		};
+		// The nodes and edges of operator<<, with every name prefixed and every line indented; with clusters, followed
+		// by a cluster per composite, see print_clusters().
+		void print_graph(std::ostream& os, const std::string& prefix, const std::string& indent, bool clusters) const;
+		template<bool Instrumented>
+		void tick();
+		// Returns whether the node was polled, rather than skipped for its inputs.
+		template<bool Instrumented>
+		auto evaluate(std::size_t i) -> bool;
+		template<bool Instrumented>
+		auto poll_entry(std::size_t i) -> poll;
+		template<bool Instrumented>
+		void evaluate_unit(std::size_t u);
+		void mark_dead(std::size_t i);
+		// Hands the polls buffered in the plan to trace_.
+		void drain_trace();
+		void run_streaming();
+		// Lazily (re)creates pool_ to match options_.workers.
+		auto worker_pool_for_run() -> internal::worker_pool&;
+		// Lazily (re)creates scheduler_ to match options_.workers and options_.pin_workers.
+		auto scheduler_for_run() -> internal::task_scheduler&;
+		template<bool Instrumented>
+		void step_work_stealing();
+
+		std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+		std::vector<node_slot> slots_{};
+		// per slot, apart from slots_ so that the plan can keep pointers to them while nodes are being created;
+		// empty until stats are first collected, as most pipelines never do
+		std::deque<node_stats> stats_{};
+		// per slot, whether its sink returned poll::closed; cleared when the sink's inputs are rewired
+		std::deque<std::atomic<bool>> closed_{};
+		std::vector<std::size_t> free_slots_{};
+		std::size_t node_count_ = 0;
+		std::uint64_t created_ = 0; // successful create_node calls, see node_slot::serial
+		std::size_t source_count_ = 0;
+		std::size_t sink_count_ = 0;
+
+		// incrementally maintained validity state, see is_valid()
+		std::size_t unfilled_slots_ = 0;
+		std::size_t dangling_nodes_ = 0; // non-sink nodes without a dependent
+		std::size_t component_count_ = 0;
+		bool components_dirty_ = false; // removals may split a component, so recount lazily
+		std::size_t next_order_ = 0;
+		bool has_cycle_ = false;
+		bool order_dirty_ = false; // removals may break the last cycle, so re-sort lazily
+
+		execution_plan plan_{};
+		std::atomic<bool> plan_dirty_ = true; // set by create_node, erase_node, connect and disconnect
+
+		// Guards the graph above (but not plan_, which only the running thread touches) against mutators on other
+		// threads. Ticks run without it.
+		mutable std::mutex graph_mutex_{};
+		bool running_ = false;
+		bool rewire_pending_ = false; // a mutator left node wiring to the next plan swap
+		std::size_t reconfigurations_ = 0; // reconfiguration guards alive
+		// nodes erased during a run, with their slot indices, still in plan_ until the next swap
+		std::vector<std::pair<node_ptr, std::size_t>> retired_{};
+
+		run_options options_{};
+		std::unique_ptr<internal::worker_pool> pool_{};
+		std::unique_ptr<internal::trace_writer> trace_{};
+		std::unique_ptr<internal::task_scheduler> scheduler_{};
 	};
 
 	std::ostream& operator<<(std::ostream& os, const pipeline& p);
+
+	// Builds a whole graph in one transaction, for large graphs that would otherwise be set up by thousands of
+	// individual connect() calls, each checked and folded into the validity state on its own.
+	// Nodes are created as by pipeline::create_node(), but edges are only recorded: commit() wires them all, checks
+	// them and the structure of the graph once, compiles the execution plan, and then replaces the target's graph.
+	//
+	//     auto builder = ppl::pipeline_builder{};
+	//     builder.reserve(nodes, edges);
+	//     auto src = builder.create_node<my_source>();
+	//     ...
+	//     builder.commit(p);
+	//
+	// IDs returned by create_node() name the same nodes in the target once committed.
+	class pipeline_builder {
+	 public:
+		using node_id = pipeline::node_id;
+
+		pipeline_builder() = default;
+		// See pipeline::pipeline(std::pmr::memory_resource*); the resource is handed to the target by commit().
+		explicit pipeline_builder(std::pmr::memory_resource* resource)
+		: staged_(resource) {}
+
+		// Sizes the builder's storage for that many nodes and edges in total.
+		void reserve(std::size_t nodes, std::size_t edges) {
+			this->staged_.slots_.reserve(nodes);
+			this->edges_.reserve(edges);
+		}
+
+		template<typename N, typename... Args>
+		    requires concrete_node<N>
+		auto create_node(Args&&... args) -> node_id {
+			return this->staged_.create_node<N>(std::forward<Args>(args)...);
+		}
+
+		// Records an edge, to be checked by commit().
+		void connect(node_id src, node_id dst, int slot) {
+			this->edges_.push_back({src, dst, slot});
+		}
+
+		// Replaces the graph of target (but not its options or trace) with the staged one. Throws pipeline_error as
+		// pipeline::connect() would for the first bad edge, or std::runtime_error if the graph would not satisfy
+		// pipeline::is_valid(); target is then left unchanged. Either way the builder is left empty.
+		void commit(pipeline& target);
+
+	 private:
+		struct staged_edge {
+			node_id src;
+			node_id dst;
+			int slot;
+		};
+
+		pipeline staged_{};
+		std::vector<staged_edge> edges_{};
+	};
+
+	namespace internal {
+		// What pipeline::compile_plan() needs to see through a composite, see node::as_composite().
+		struct composite_parts {
+			pipeline* fragment = nullptr;
+			std::span<node* const> inputs{};
+			node* output = nullptr;
+		};
+	} // namespace internal
+
+	// The input placeholder for one input of a composite: create one per input of the composite in its fragment,
+	// and connect it to the nodes that consume that input. Its slot is left unconnected in the fragment; the
+	// composite feeds it with whatever the composite itself is connected to.
+	template<typename T>
+	struct composite_input final : component<std::tuple<T>, T> {
+		[[nodiscard]] auto name() const -> std::string override {
+			return "input";
+		}
+		auto value() const -> const T& override {
+			return this->template input<0>();
+		}
+		// Only asked for when the consumer of this placeholder is the only consumer of the composite's input.
+		auto take_value() -> T override {
+			return const_cast<producer<T>*>(this->template input_source<0>())->take_value();
+		}
+		[[nodiscard]] auto shared() const -> shared_value<T> override {
+			return this->template input_source<0>()->shared();
+		}
+
+	 private:
+		// never polled: the plan feeds the placeholder's consumers straight from the composite's input
+		auto poll_next() -> poll override {
+			return poll::ready;
+		}
+	};
+
+	// A node made of a whole pipeline, its fragment, which is flattened into the plan of any pipeline it is added
+	// to, so that composing graphs out of reusable subgraphs costs nothing per tick. A fragment is built like any
+	// pipeline, except that it is fed through one composite_input<T> per input slot of the composite and that one
+	// of its nodes, output, is left without dependents: its values become the composite's.
+	//
+	//     auto fragment = ppl::pipeline{};
+	//     auto in = fragment.create_node<ppl::composite_input<int>>();
+	//     auto out = fragment.create_node<add_one>();
+	//     fragment.connect(in, out, 0);
+	//     auto id = p.create_node<ppl::composite<std::tuple<int>, int>>(std::move(fragment), std::array{in}, out);
+	//
+	// The constructor throws std::invalid_argument unless every placeholder is a composite_input of its slot's type,
+	// output produces Output, and the fragment is one connected, acyclic graph in which only the placeholders' slots
+	// are unconnected and only output may lack a dependent. Composites may contain composites.
+	// The fragment's nodes keep their run-time statistics in the fragment, see fragment().
+	template<typename Input, typename Output>
+	class composite final : public component<Input, Output> {
+		static_assert(!std::is_void_v<Output>, "a composite needs an output node");
+
+	 public:
+		static constexpr auto input_count = std::tuple_size_v<Input>;
+
+		composite(pipeline fragment, std::array<pipeline::node_id, input_count> inputs, pipeline::node_id output)
+		: fragment_(std::move(fragment)) {
+			this->bind_placeholders(inputs, std::make_index_sequence<input_count>{});
+			this->output_ = dynamic_cast<producer<Output>*>(this->fragment_.get_node(output));
+			if (this->output_ == nullptr) {
+				throw std::invalid_argument("composite: the output node does not produce the composite's output");
+			}
+			this->fragment_.check_fragment(this->placeholders_, this->output_);
+			this->parts_ = {&this->fragment_, this->placeholders_, this->output_};
+		}
+		composite(const composite&) = delete;
+		auto operator=(const composite&) -> composite& = delete;
+
+		[[nodiscard]] auto name() const -> std::string override {
+			return "composite";
+		}
+		auto value() const -> const Output& override {
+			return this->output_->value();
+		}
+		auto take_value() -> Output override {
+			return this->output_->take_value();
+		}
+		[[nodiscard]] auto shared() const -> shared_value<Output> override {
+			return this->output_->shared();
+		}
+
+		// The graph this composite runs, e.g. for the statistics of the nodes within it.
+		[[nodiscard]] auto fragment() const noexcept -> const pipeline& {
+			return this->fragment_;
+		}
+
+		auto connect(const node* source, int slot) -> void override {
+			component<Input, Output>::connect(source, slot);
+			this->placeholders_[static_cast<std::size_t>(slot)]->connect(source, 0);
+		}
+
+	 private:
+		template<std::size_t... Is>
+		void bind_placeholders(const std::array<pipeline::node_id, input_count>& inputs, std::index_sequence<Is...>) {
+			auto bind = [this](pipeline::node_id id, std::size_t slot, auto* placeholder) {
+				placeholder = dynamic_cast<decltype(placeholder)>(this->fragment_.get_node(id));
+				if (placeholder == nullptr) {
+					throw std::invalid_argument("composite: input " + std::to_string(slot)
+					                            + " is not a composite_input of the slot's type");
+				}
+				this->placeholders_[slot] = placeholder;
+			};
+			(bind(inputs[Is], Is, static_cast<composite_input<std::tuple_element_t<Is, Input>>*>(nullptr)), ...);
+		}
+
+		// the plan polls the fragment's nodes in place of this one
+		auto poll_next() -> poll override {
+			return poll::closed;
+		}
+		[[nodiscard]] auto as_composite() const -> const internal::composite_parts* override {
+			return &this->parts_;
+		}
+
+		pipeline fragment_;
+		std::array<node*, input_count> placeholders_{};
+		producer<Output>* output_ = nullptr;
+		internal::composite_parts parts_{};
+	};
 } // namespace ppl
 
 #endif // COMP6771_PIPELINE_H
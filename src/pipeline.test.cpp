@@ -1,7 +1,22 @@
 #include "./pipeline.h"
+#include "./node_factory.h"
+#include "./snapshot.h"
+#include "./static_pipeline.h"
 
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
 #include <sstream>
+#include <thread>
 
 using namespace ppl;
 
@@ -146,3 +161,1947 @@ TEST_CASE("ostream"){
 
 
 
+
+struct counting_source : ppl::source<int> {
+	int current_value = 0;
+	int limit;
+	explicit counting_source(int limit_ = 10) : limit(limit_) {}
+	auto name() const -> std::string override {
+		return "CountingSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		if (current_value >= limit)
+			return ppl::poll::closed;
+		++current_value;
+		return ppl::poll::ready;
+	}
+	auto value() const -> const int& override {
+		return current_value;
+	}
+};
+
+struct add_one : ppl::component<std::tuple<int>, int> {
+	const ppl::producer<int>* slot0 = nullptr;
+	int current_value = 0;
+	auto name() const -> std::string override {
+		return "AddOne";
+	}
+	void connect(const ppl::node* src, int slot) override {
+		if (slot == 0) {
+			slot0 = static_cast<const ppl::producer<int>*>(src);
+		}
+	}
+	auto poll_next() -> ppl::poll override {
+		current_value = slot0->value() + 1;
+		return ppl::poll::ready;
+	}
+	auto value() const -> const int& override {
+		return current_value;
+	}
+};
+
+struct recording_sink : ppl::sink<int> {
+	const ppl::producer<int>* slot0 = nullptr;
+	std::vector<int>* out;
+	explicit recording_sink(std::vector<int>* out_) : out(out_) {}
+	auto name() const -> std::string override {
+		return "RecordingSink";
+	}
+	void connect(const ppl::node* src, int slot) override {
+		if (slot == 0) {
+			slot0 = static_cast<const ppl::producer<int>*>(src);
+		}
+	}
+	auto poll_next() -> ppl::poll override {
+		out->push_back(slot0->value());
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("run: values flow through a chain in topological order"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto snk = p.create_node<recording_sink>(&out);
+	auto mid = p.create_node<add_one>();
+	auto src = p.create_node<counting_source>(3);
+	p.connect(src, mid, 0);
+	p.connect(mid, snk, 0);
+	p.run();
+	REQUIRE(out.size() >= 3);
+	REQUIRE(std::vector<int>(out.begin(), out.begin() + 3) == std::vector<int>{2, 3, 4});
+}
+
+TEST_CASE("step: the cached plan is invalidated by graph mutations"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto snk = p.create_node<recording_sink>(&out);
+	auto src = p.create_node<counting_source>(100);
+	p.connect(src, snk, 0);
+	REQUIRE_FALSE(p.step());
+	REQUIRE(out == std::vector<int>{1});
+
+	auto mid = p.create_node<add_one>();
+	REQUIRE_THROWS_AS(p.step(), std::runtime_error);
+	p.disconnect(src, snk);
+	p.connect(src, mid, 0);
+	p.connect(mid, snk, 0);
+	REQUIRE_FALSE(p.step());
+	REQUIRE(out == std::vector<int>{1, 3});
+}
+
+TEST_CASE("get_dependencies tracks connect, disconnect and erase_node"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>();
+	auto a = p.create_node<add_one>();
+	auto b = p.create_node<add_one>();
+	auto snk = p.create_node<recording_sink>(&out);
+	p.connect(src, a, 0);
+	p.connect(src, b, 0);
+	p.connect(a, snk, 0);
+	using dep = std::pair<ppl::pipeline::node_id, int>;
+	REQUIRE(p.get_dependencies(src) == std::vector<dep>{{a, 0}, {b, 0}});
+	p.disconnect(src, a);
+	REQUIRE(p.get_dependencies(src) == std::vector<dep>{{b, 0}});
+	p.erase_node(b);
+	REQUIRE(p.get_dependencies(src).empty());
+	p.erase_node(a);
+	REQUIRE_THROWS_AS(p.get_dependencies(a), ppl::pipeline_error);
+	p.connect(src, snk, 0);
+	REQUIRE(p.get_dependencies(src) == std::vector<dep>{{snk, 0}});
+	REQUIRE(p.is_valid());
+}
+
+struct sum_two : ppl::component<std::tuple<int, int>, int> {
+	const ppl::producer<int>* slot0 = nullptr;
+	const ppl::producer<int>* slot1 = nullptr;
+	int current_value = 0;
+	auto name() const -> std::string override {
+		return "SumTwo";
+	}
+	void connect(const ppl::node* src, int slot) override {
+		(slot == 0 ? slot0 : slot1) = static_cast<const ppl::producer<int>*>(src);
+	}
+	auto poll_next() -> ppl::poll override {
+		current_value = slot0->value() + slot1->value();
+		return ppl::poll::ready;
+	}
+	auto value() const -> const int& override {
+		return current_value;
+	}
+};
+
+TEST_CASE("is_valid: incremental tracking agrees with a from-scratch check"){
+	using id_t = ppl::pipeline::node_id;
+	// model of the graph: kind (0 source, 1 add_one, 2 sum_two, 3 sink) and the source of each slot (0 if unfilled)
+	struct model_node {
+		int kind;
+		std::vector<id_t> inputs;
+	};
+	auto reference_valid = [](const std::map<id_t, model_node>& g) {
+		auto sources = 0, sinks = 0;
+		std::map<id_t, int> dependents{};
+		std::map<id_t, id_t> parent{};
+		std::function<id_t(id_t)> find = [&](id_t x) { return parent[x] == x ? x : find(parent[x]); };
+		for (auto& [id, n] : g) {
+			parent[id] = id;
+		}
+		auto components = g.size();
+		for (auto& [id, n] : g) {
+			sources += n.kind == 0;
+			sinks += n.kind == 3;
+			for (auto in : n.inputs) {
+				if (in == 0)
+					return false;
+				++dependents[in];
+				if (find(in) != find(id)) {
+					parent[find(in)] = find(id);
+					--components;
+				}
+			}
+		}
+		for (auto& [id, n] : g) {
+			if (n.kind != 3 && dependents[id] == 0)
+				return false;
+		}
+		if (sources == 0 || sinks == 0 || components != 1)
+			return false;
+		// Kahn's algorithm must be able to order every node
+		std::map<id_t, std::size_t> in_degree{};
+		std::vector<id_t> ready{};
+		for (auto& [id, n] : g) {
+			in_degree[id] = n.inputs.size();
+			if (n.inputs.empty())
+				ready.push_back(id);
+		}
+		auto sorted = 0u;
+		while (!ready.empty()) {
+			auto id = ready.back();
+			ready.pop_back();
+			++sorted;
+			for (auto& [dst, n] : g) {
+				for (auto in : n.inputs) {
+					if (in == id && --in_degree[dst] == 0)
+						ready.push_back(dst);
+				}
+			}
+		}
+		return sorted == g.size();
+	};
+
+	std::mt19937 rng{6771};
+	std::vector<int> out{};
+	for (auto round = 0; round < 50; ++round) {
+		ppl::pipeline p{};
+		std::map<id_t, model_node> g{};
+		auto create = [&](int kind) {
+			auto id = kind == 0 ? p.create_node<counting_source>()
+			        : kind == 1 ? p.create_node<add_one>()
+			        : kind == 2 ? p.create_node<sum_two>()
+			                    : p.create_node<recording_sink>(&out);
+			g[id] = model_node{kind, std::vector<id_t>(kind == 0 ? 0u : kind == 2 ? 2u : 1u, 0)};
+		};
+		auto pick = [&]() {
+			auto it = g.begin();
+			std::advance(it, static_cast<long>(rng() % g.size()));
+			return it->first;
+		};
+		auto try_connect = [&](id_t src, id_t dst, std::size_t slot) {
+			if (src == dst)
+				return;
+			try {
+				p.connect(src, dst, static_cast<int>(slot));
+				g.at(dst).inputs.at(slot) = src;
+			} catch (const ppl::pipeline_error&) {
+			}
+		};
+		create(0);
+		create(3);
+		for (auto op = 0; op < 400; ++op) {
+			auto choice = rng() % 10;
+			auto dst = pick();
+			auto& inputs = g.at(dst).inputs;
+			auto slot = inputs.empty() ? 0u : rng() % inputs.size();
+			if (choice < 2) {
+				auto roll = rng() % 10;
+				if (g.size() < 7)
+					create(roll == 0 ? 0 : roll < 5 ? 1 : roll < 7 ? 2 : 3);
+			}
+			else if (choice < 3) {
+				if (g.size() > 2) {
+					p.erase_node(dst);
+					g.erase(dst);
+					for (auto& [_, n] : g) {
+						std::replace(n.inputs.begin(), n.inputs.end(), dst, id_t{0});
+					}
+				}
+			}
+			else if (choice < 6) {
+				if (!inputs.empty() && inputs[slot] == 0)
+					try_connect(pick(), dst, slot);
+			}
+			else if (!inputs.empty() && inputs[slot] != 0) {
+				// rewire: most of these keep every slot filled and only change the shape
+				auto src = inputs[slot];
+				p.disconnect(src, dst);
+				std::replace(inputs.begin(), inputs.end(), src, id_t{0});
+				if (rng() % 4 != 0)
+					try_connect(pick(), dst, slot);
+			}
+			REQUIRE(p.is_valid() == reference_valid(g));
+		}
+	}
+}
+
+TEST_CASE("is_valid: cycles are detected as edges are added out of creation order"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	// created back to front, so every connect below has to reorder the tracked topological order
+	auto snk = p.create_node<recording_sink>(&out);
+	auto c = p.create_node<add_one>();
+	auto b = p.create_node<add_one>();
+	auto a = p.create_node<sum_two>();
+	auto src = p.create_node<counting_source>();
+	p.connect(a, b, 0);
+	p.connect(b, c, 0);
+	p.connect(c, snk, 0);
+	p.connect(src, a, 0);
+	REQUIRE_FALSE(p.is_valid());
+
+	// a -> b -> c -> a
+	auto d = p.create_node<add_one>();
+	p.connect(c, d, 0);
+	p.connect(d, a, 1);
+	REQUIRE_FALSE(p.is_valid());
+
+	// breaking the cycle and feeding a from the source again makes it valid
+	p.disconnect(d, a);
+	p.erase_node(d);
+	p.connect(src, a, 1);
+	REQUIRE(p.is_valid());
+
+	// closing it again, this time with a removal in between
+	p.disconnect(src, a);
+	p.connect(c, a, 0);
+	p.connect(src, a, 1);
+	REQUIRE_FALSE(p.is_valid());
+	p.disconnect(c, a);
+	p.connect(src, a, 0);
+	REQUIRE(p.is_valid());
+}
+
+TEST_CASE("node_id: erased slots are recycled and stale IDs are rejected"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>();
+	auto snk = p.create_node<recording_sink>(&out);
+	REQUIRE(src == 1);
+	REQUIRE(snk == 2);
+
+	p.erase_node(snk);
+	auto snk2 = p.create_node<recording_sink>(&out);
+	REQUIRE(snk2 != snk);
+	REQUIRE_THROWS_AS(p.get_node(snk), ppl::pipeline_error);
+	REQUIRE_THROWS_AS(p.connect(src, snk, 0), ppl::pipeline_error);
+	REQUIRE_THROWS_AS(p.erase_node(snk), ppl::pipeline_error);
+	REQUIRE_THROWS_AS(p.get_node(0), ppl::pipeline_error);
+	p.connect(src, snk2, 0);
+	REQUIRE(p.is_valid());
+
+	// far more than 65535 creations in a long-lived pipeline
+	for (auto i = 0; i < 70000; ++i) {
+		p.erase_node(p.create_node<add_one>());
+	}
+	auto last = p.create_node<add_one>();
+	REQUIRE_NOTHROW(p.get_node(last));
+	p.erase_node(last);
+	REQUIRE(p.is_valid());
+}
+
+TEST_CASE("ostream: nodes are numbered by creation, also in reused slots"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>();
+	auto mid = p.create_node<add_one>();
+	auto snk = p.create_node<recording_sink>(&out);
+	p.erase_node(mid);
+	mid = p.create_node<add_one>();
+	p.connect(src, mid, 0);
+	p.connect(mid, snk, 0);
+	REQUIRE(mid != 4); // the ID carries the slot's generation
+	auto dot = std::ostringstream{};
+	dot << p;
+	REQUIRE(dot.str() == R"(digraph G {
+  "1 CountingSource"
+  "3 RecordingSink"
+  "4 AddOne"
+
+  "1 CountingSource" -> "4 AddOne"
+  "4 AddOne" -> "3 RecordingSink"
+}
+)");
+}
+
+TEST_CASE("is_valid: a long run of reconfigurations keeps the graph ordered"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>(100);
+	auto snk = p.create_node<recording_sink>(&out);
+	auto mid = p.create_node<add_one>();
+	p.connect(src, mid, 0);
+	p.connect(mid, snk, 0);
+	// every replacement is created after the sink, so it has to be ordered before it again
+	for (auto i = 0; i < 20000; ++i) {
+		p.erase_node(mid);
+		mid = p.create_node<add_one>();
+		p.connect(mid, snk, 0);
+		p.connect(src, mid, 0);
+		REQUIRE(p.is_valid());
+		if (i % 1000 == 0) {
+			REQUIRE_FALSE(p.step());
+		}
+	}
+	out.clear();
+	p.run();
+	REQUIRE(out.size() == 80);
+	REQUIRE(out.back() == 101);
+}
+
+TEST_CASE("connect: slot bounds are checked before the slot is inspected"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>();
+	auto snk = p.create_node<recording_sink>(&out);
+	try {
+		p.connect(src, snk, 1);
+		FAIL();
+	} catch (ppl::pipeline_error& e) {
+		REQUIRE(e.kind() == ppl::pipeline_error_kind::no_such_slot);
+	}
+	try {
+		p.connect(src, snk, -1);
+		FAIL();
+	} catch (ppl::pipeline_error& e) {
+		REQUIRE(e.kind() == ppl::pipeline_error_kind::no_such_slot);
+	}
+}
+
+TEST_CASE("level_parallel: wide fan-out gives the same results as serial execution"){
+	auto run_with = [](ppl::execution_mode mode) {
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{mode, 4});
+		std::vector<std::vector<int>> outs(64);
+		auto src = p.create_node<counting_source>(50);
+		for (auto& out : outs) {
+			auto a = p.create_node<add_one>();
+			auto b = p.create_node<add_one>();
+			auto snk = p.create_node<recording_sink>(&out);
+			p.connect(src, a, 0);
+			p.connect(a, b, 0);
+			p.connect(b, snk, 0);
+		}
+		p.run();
+		return outs;
+	};
+	auto serial = run_with(ppl::execution_mode::serial);
+	auto parallel = run_with(ppl::execution_mode::level_parallel);
+	REQUIRE(serial.front().size() >= 50);
+	REQUIRE(serial.front().front() == 3);
+	REQUIRE(parallel == serial);
+}
+
+struct throwing_sink : ppl::sink<int> {
+	auto name() const -> std::string override {
+		return "ThrowingSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		throw std::runtime_error("sink failed");
+	}
+};
+
+TEST_CASE("level_parallel: an exception thrown by a node reaches the caller"){
+	ppl::pipeline p{};
+	p.set_options(ppl::run_options{ppl::execution_mode::level_parallel, 3});
+	auto src = p.create_node<counting_source>();
+	std::vector<int> out{};
+	p.connect(src, p.create_node<throwing_sink>(), 0);
+	p.connect(src, p.create_node<recording_sink>(&out), 0);
+	REQUIRE_THROWS_WITH(p.step(), "sink failed");
+}
+
+TEST_CASE("streaming: results match serial execution, including a diamond and an early-closing sink"){
+	struct stop_after : ppl::sink<int> {
+		const ppl::producer<int>* slot0 = nullptr;
+		std::vector<int>* out;
+		std::size_t limit;
+		stop_after(std::vector<int>* out_, std::size_t limit_) : out(out_), limit(limit_) {}
+		auto name() const -> std::string override {
+			return "StopAfter";
+		}
+		void connect(const ppl::node* src, int slot) override {
+			if (slot == 0) {
+				slot0 = static_cast<const ppl::producer<int>*>(src);
+			}
+		}
+		auto poll_next() -> ppl::poll override {
+			if (out->size() >= limit)
+				return ppl::poll::closed;
+			out->push_back(slot0->value());
+			return ppl::poll::ready;
+		}
+	};
+
+	auto run_with = [](ppl::execution_mode mode) {
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{mode, 0, 2});
+		std::vector<int> diamond{};
+		std::vector<int> early{};
+		auto src = p.create_node<counting_source>(1000);
+		auto a = p.create_node<add_one>();
+		auto b = p.create_node<add_one>();
+		auto c = p.create_node<add_one>();
+		auto sum = p.create_node<sum_two>();
+		p.connect(src, a, 0);
+		p.connect(a, b, 0);
+		p.connect(a, c, 0);
+		p.connect(b, sum, 0);
+		p.connect(c, sum, 1);
+		p.connect(sum, p.create_node<recording_sink>(&diamond), 0);
+		p.connect(c, p.create_node<stop_after>(&early, 10), 0);
+		p.run();
+		return std::make_pair(diamond, early);
+	};
+	auto [diamond, early] = run_with(ppl::execution_mode::streaming);
+	REQUIRE(diamond.size() == 1000);
+	REQUIRE(diamond.front() == 6);
+	REQUIRE(diamond.back() == 2004);
+	REQUIRE(early == std::vector<int>{3, 4, 5, 6, 7, 8, 9, 10, 11, 12});
+
+	auto serial = run_with(ppl::execution_mode::serial);
+	REQUIRE(std::vector<int>(serial.first.begin(), serial.first.begin() + 1000) == diamond);
+	REQUIRE(serial.second == early);
+}
+
+struct thread_noting_add_one : add_one {
+	std::mutex* mutex;
+	std::set<std::thread::id>* threads;
+	thread_noting_add_one(std::mutex* mutex_, std::set<std::thread::id>* threads_)
+	: mutex(mutex_)
+	, threads(threads_) {}
+	auto poll_next() -> ppl::poll override {
+		{
+			auto lock = std::lock_guard{*mutex};
+			threads->insert(std::this_thread::get_id());
+		}
+		return add_one::poll_next();
+	}
+};
+
+TEST_CASE("streaming: many nodes share a bounded number of threads"){
+	for (auto workers : {std::size_t{1}, std::size_t{3}}){
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{ppl::execution_mode::streaming, workers, 1});
+		std::mutex mutex{};
+		std::set<std::thread::id> threads{};
+		std::vector<int> out{};
+		// a diamond of two long chains, with queues of a single token
+		auto src = p.create_node<counting_source>(200);
+		auto sum = p.create_node<sum_two>();
+		for (auto branch = 0; branch < 2; ++branch){
+			auto prev = src;
+			for (auto k = 0; k < 20; ++k){
+				auto next = p.create_node<thread_noting_add_one>(&mutex, &threads);
+				p.connect(prev, next, 0);
+				prev = next;
+			}
+			p.connect(prev, sum, branch);
+		}
+		p.connect(sum, p.create_node<recording_sink>(&out), 0);
+		p.run();
+		REQUIRE(out.size() == 200);
+		REQUIRE(out.front() == 42);
+		REQUIRE(out.back() == 440);
+		REQUIRE(threads.size() <= workers);
+		if (workers == 1){
+			REQUIRE(threads == std::set<std::thread::id>{std::this_thread::get_id()});
+		}
+	}
+}
+
+TEST_CASE("streaming: the pipeline can still be stepped after a streaming run"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>(5);
+	auto snk = p.create_node<recording_sink>(&out);
+	p.connect(src, snk, 0);
+	p.set_options(ppl::run_options{ppl::execution_mode::streaming});
+	p.run();
+	REQUIRE(out == std::vector<int>{1, 2, 3, 4, 5});
+	// consumers are wired back to their real producers
+	REQUIRE(p.step());
+	REQUIRE(out.back() == 5);
+}
+
+TEST_CASE("streaming: an exception thrown by a node ends the run beside a branch that never closes"){
+	struct endless_sink : ppl::sink<int> {
+		auto name() const -> std::string override {
+			return "EndlessSink";
+		}
+		auto poll_next() -> ppl::poll override {
+			return ppl::poll::ready;
+		}
+	};
+	for (auto workers : {std::size_t{1}, std::size_t{4}}){
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{ppl::execution_mode::streaming, workers});
+		auto src = p.create_node<counting_source>(std::numeric_limits<int>::max());
+		auto mid = p.create_node<add_one>();
+		p.connect(src, mid, 0);
+		p.connect(mid, p.create_node<throwing_sink>(), 0);
+		p.connect(src, p.create_node<endless_sink>(), 0);
+		REQUIRE_THROWS_WITH(p.run(), "sink failed");
+	}
+}
+
+TEST_CASE("work_stealing: irregular graphs give the same results as serial execution"){
+	auto run_with = [](ppl::run_options options) {
+		ppl::pipeline p{};
+		p.set_options(options);
+		std::vector<std::vector<int>> outs(16);
+		auto src = p.create_node<counting_source>(40);
+		for (auto k = 0u; k < outs.size(); ++k) {
+			// branches of different lengths, some of them merging back into a sum
+			auto tail = src;
+			for (auto len = 0u; len <= k % 5; ++len) {
+				auto next = p.create_node<add_one>();
+				p.connect(tail, next, 0);
+				tail = next;
+			}
+			auto sum = p.create_node<sum_two>();
+			p.connect(tail, sum, 0);
+			p.connect(src, sum, 1);
+			p.connect(sum, p.create_node<recording_sink>(&outs[k]), 0);
+		}
+		p.run();
+		return outs;
+	};
+	auto serial = run_with(ppl::run_options{});
+	REQUIRE(serial[0].front() == 3);
+	auto stealing = ppl::run_options{};
+	stealing.mode = ppl::execution_mode::work_stealing;
+	stealing.workers = 4;
+	REQUIRE(run_with(stealing) == serial);
+	stealing.pin_workers = true;
+	REQUIRE(run_with(stealing) == serial);
+}
+
+TEST_CASE("work_stealing: an exception thrown by a node reaches the caller"){
+	ppl::pipeline p{};
+	auto options = ppl::run_options{};
+	options.mode = ppl::execution_mode::work_stealing;
+	options.workers = 3;
+	p.set_options(options);
+	auto src = p.create_node<counting_source>();
+	std::vector<int> out{};
+	auto mid = p.create_node<add_one>();
+	p.connect(src, mid, 0);
+	p.connect(mid, p.create_node<throwing_sink>(), 0);
+	p.connect(src, p.create_node<recording_sink>(&out), 0);
+	REQUIRE_THROWS_WITH(p.step(), "sink failed");
+	REQUIRE_THROWS_WITH(p.step(), "sink failed");
+}
+
+struct batch_source : ppl::source<int> {
+	int current_value = 0;
+	int limit;
+	std::vector<int> buffer{};
+	int* batch_polls;
+	batch_source(int limit_, int* batch_polls_) : limit(limit_), batch_polls(batch_polls_) {}
+	auto name() const -> std::string override {
+		return "BatchSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		if (current_value >= limit)
+			return ppl::poll::closed;
+		++current_value;
+		return ppl::poll::ready;
+	}
+	auto value() const -> const int& override {
+		return current_value;
+	}
+	auto supports_batch() const -> bool override {
+		return true;
+	}
+	auto poll_batch(std::size_t max) -> ppl::poll override {
+		++*batch_polls;
+		buffer.clear();
+		while (buffer.size() < max && current_value < limit) {
+			buffer.push_back(++current_value);
+		}
+		return buffer.empty() ? ppl::poll::closed : ppl::poll::ready;
+	}
+	auto batch() const -> std::span<const int> override {
+		return buffer;
+	}
+};
+
+struct batch_sink : ppl::sink<int> {
+	const ppl::producer<int>* slot0 = nullptr;
+	std::vector<int>* out;
+	explicit batch_sink(std::vector<int>* out_) : out(out_) {}
+	auto name() const -> std::string override {
+		return "BatchSink";
+	}
+	void connect(const ppl::node* src, int slot) override {
+		if (slot == 0) {
+			slot0 = static_cast<const ppl::producer<int>*>(src);
+		}
+	}
+	auto poll_next() -> ppl::poll override {
+		out->push_back(slot0->value());
+		return ppl::poll::ready;
+	}
+	auto accepts_batch() const -> bool override {
+		return true;
+	}
+	auto consume_batch(std::span<const int> values) -> ppl::poll override {
+		out->insert(out->end(), values.begin(), values.end());
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("batch: a batching producer feeding a batching consumer moves many values per tick"){
+	auto batch_polls = 0;
+	std::vector<int> out{};
+	ppl::pipeline p{};
+	auto options = ppl::run_options{};
+	options.batch_size = 100;
+	p.set_options(options);
+	p.connect(p.create_node<batch_source>(1000, &batch_polls), p.create_node<batch_sink>(&out), 0);
+	p.run();
+	REQUIRE(batch_polls == 11); // ten full batches, then closed
+	REQUIRE(out.size() == 1000);
+	REQUIRE(out.front() == 1);
+	REQUIRE(out.back() == 1000);
+}
+
+TEST_CASE("batch: edges fall back to scalar polling unless both ends batch and the producer has one dependent"){
+	auto batch_polls = 0;
+	std::vector<int> batched{};
+	std::vector<int> scalar{};
+	ppl::pipeline p{};
+	auto src = p.create_node<batch_source>(5, &batch_polls);
+	p.connect(src, p.create_node<batch_sink>(&batched), 0);
+	p.connect(src, p.create_node<recording_sink>(&scalar), 0);
+	p.run();
+	REQUIRE(batch_polls == 0);
+	REQUIRE(std::vector<int>(batched.begin(), batched.begin() + 5) == std::vector<int>{1, 2, 3, 4, 5});
+
+	// disabled through the options
+	ppl::pipeline q{};
+	auto options = ppl::run_options{};
+	options.batch_size = 0;
+	q.set_options(options);
+	batched.clear();
+	q.connect(q.create_node<batch_source>(5, &batch_polls), q.create_node<batch_sink>(&batched), 0);
+	q.run();
+	REQUIRE(batch_polls == 0);
+	REQUIRE(std::vector<int>(batched.begin(), batched.begin() + 5) == std::vector<int>{1, 2, 3, 4, 5});
+}
+
+struct counting_add_one : add_one {
+	int* polls;
+	explicit counting_add_one(int* polls_) : polls(polls_) {}
+	auto poll_next() -> ppl::poll override {
+		++*polls;
+		return add_one::poll_next();
+	}
+};
+
+struct closing_sink : ppl::sink<int> {
+	int remaining;
+	explicit closing_sink(int remaining_) : remaining(remaining_) {}
+	auto name() const -> std::string override {
+		return "ClosingSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		return remaining-- > 0 ? ppl::poll::ready : ppl::poll::closed;
+	}
+};
+
+TEST_CASE("liveness: branches that only feed closed sinks stop being polled"){
+	ppl::pipeline p{};
+	std::vector<int> out{};
+	auto dead_polls = 0;
+	auto shared_polls = 0;
+	auto src = p.create_node<counting_source>(100);
+	auto shared = p.create_node<counting_add_one>(&shared_polls);
+	auto dead = p.create_node<counting_add_one>(&dead_polls);
+	auto early = p.create_node<closing_sink>(3);
+	p.connect(src, shared, 0);
+	p.connect(shared, dead, 0);
+	p.connect(dead, early, 0);
+	p.connect(shared, p.create_node<recording_sink>(&out), 0);
+	p.run();
+	REQUIRE(dead_polls == 4); // three ready ticks and the tick on which its sink closed
+	REQUIRE(shared_polls >= 100);
+	REQUIRE(out.size() >= 100);
+
+	// liveness is recomputed with the plan: a sink that only closed because its input did is polled again once
+	// it has a live input, and the branch feeding it is revived
+	auto fresh = p.create_node<counting_source>(2);
+	p.disconnect(src, shared);
+	p.connect(fresh, shared, 0);
+	p.erase_node(src);
+	p.run();
+	REQUIRE(out.size() >= 102);
+	REQUIRE(out.back() == 3);
+	REQUIRE(dead_polls == 4); // early closed itself, and still does
+}
+
+TEST_CASE("liveness: a sink that closed itself stays closed across plan rebuilds until it is rewired"){
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::work_stealing})
+	{
+		ppl::pipeline p{};
+		p.set_options({mode, 2});
+		std::vector<int> out{};
+		auto dead_polls = 0;
+		auto src = p.create_node<counting_source>(1000);
+		auto dead = p.create_node<counting_add_one>(&dead_polls);
+		auto early = p.create_node<closing_sink>(3);
+		p.connect(src, dead, 0);
+		p.connect(dead, early, 0);
+		p.connect(src, p.create_node<recording_sink>(&out), 0);
+		p.run_for(10);
+		REQUIRE(dead_polls == 4);
+
+		// a new plan, for the new options, must not revive the branch behind early
+		for (auto batch_size : {std::size_t{4}, std::size_t{0}}){
+			auto options = p.options();
+			options.batch_size = batch_size;
+			p.set_options(options);
+			p.run_for(10);
+		}
+		REQUIRE(dead_polls == 4);
+		REQUIRE(out.size() >= 30);
+
+		// feeding early from elsewhere lets it decide again: it is polled once more, and closes
+		auto fresh_polls = 0;
+		auto fresh = p.create_node<counting_add_one>(&fresh_polls);
+		p.erase_node(dead);
+		p.connect(src, fresh, 0);
+		p.connect(fresh, early, 0);
+		p.run_for(10);
+		REQUIRE(fresh_polls == 1);
+		REQUIRE(dead_polls == 4);
+	}
+}
+
+struct every_other_source : ppl::source<int> {
+	int ticks = 0;
+	auto name() const -> std::string override {
+		return "EveryOtherSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		++ticks;
+		if (ticks > 10) return ppl::poll::closed;
+		return ticks % 2 == 0 ? ppl::poll::ready : ppl::poll::empty;
+	}
+	auto value() const -> const int& override {
+		return ticks;
+	}
+};
+
+TEST_CASE("step: nodes are only polled when every input is ready"){
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::work_stealing})
+	{
+		ppl::pipeline p{};
+		p.set_options({mode, 2});
+		std::vector<int> out{};
+		auto polls = 0;
+		auto src = p.create_node<every_other_source>();
+		auto inc = p.create_node<counting_add_one>(&polls);
+		p.connect(src, inc, 0);
+		p.connect(inc, p.create_node<recording_sink>(&out), 0);
+
+		REQUIRE_FALSE(p.step()); // empty: nothing downstream is polled
+		REQUIRE(polls == 0);
+		REQUIRE(out.empty());
+		p.run();
+		REQUIRE(polls == 5);
+		REQUIRE(out == std::vector<int>{3, 5, 7, 9, 11});
+	}
+}
+
+TEST_CASE("static_pipeline: a fixed diamond gives the same results as the dynamic pipeline"){
+	std::vector<int> dynamic_out{};
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>(50);
+	auto inc = p.create_node<add_one>();
+	auto sum = p.create_node<sum_two>();
+	p.connect(src, inc, 0);
+	p.connect(inc, sum, 0);
+	p.connect(src, sum, 1);
+	p.connect(sum, p.create_node<recording_sink>(&dynamic_out), 0);
+	p.run();
+
+	std::vector<int> static_out{};
+	using diamond = ppl::static_pipeline<std::tuple<counting_source, add_one, sum_two, recording_sink>,
+	                                     ppl::static_edge<0, 1, 0>,
+	                                     ppl::static_edge<1, 2, 0>,
+	                                     ppl::static_edge<0, 2, 1>,
+	                                     ppl::static_edge<2, 3, 0>>;
+	diamond s{std::make_tuple(50), std::make_tuple(), std::make_tuple(), std::make_tuple(&static_out)};
+	REQUIRE_FALSE(s.step());
+	REQUIRE(s.get<2>().value() == 3);
+	s.run();
+	REQUIRE(static_out == dynamic_out);
+	REQUIRE(s.step()); // stays finished
+
+	// edges may be listed in any order, and empty ticks skip everything downstream
+	std::vector<int> out{};
+	auto polls = 0;
+	ppl::static_pipeline<std::tuple<every_other_source, counting_add_one, recording_sink>,
+	                     ppl::static_edge<1, 2, 0>,
+	                     ppl::static_edge<0, 1, 0>>
+	   t{std::make_tuple(), std::make_tuple(&polls), std::make_tuple(&out)};
+	t.run();
+	REQUIRE(polls == 5);
+	REQUIRE(out == std::vector<int>{3, 5, 7, 9, 11});
+}
+
+TEST_CASE("fusion: fused chains give the same results as unfused execution in every tick mode"){
+	// two chains of add_one meet in a sum_two, whose output runs down a third chain into the sink;
+	// the source feeds both chains, so it is the only node that is not fused into a chain
+	auto run_with = [](ppl::execution_mode mode, bool fuse) {
+		ppl::pipeline p{};
+		auto options = ppl::run_options{mode, 3};
+		options.fuse_chains = fuse;
+		p.set_options(options);
+		std::vector<int> out{};
+		// one counter per node, as nodes of different chains may be polled concurrently
+		auto counters = std::vector<int>(12, 0);
+		auto used = 0u;
+		auto src = p.create_node<every_other_source>();
+		auto chain = [&p, &counters, &used](ppl::pipeline::node_id from, int length) {
+			for (auto k = 0; k < length; ++k){
+				auto next = p.create_node<counting_add_one>(&counters[used++]);
+				p.connect(from, next, 0);
+				from = next;
+			}
+			return from;
+		};
+		auto sum = p.create_node<sum_two>();
+		p.connect(chain(src, 3), sum, 0);
+		p.connect(chain(src, 5), sum, 1);
+		auto sink = p.create_node<recording_sink>(&out);
+		p.connect(chain(sum, 4), sink, 0);
+		p.run();
+		return std::pair{out, std::accumulate(counters.begin(), counters.end(), 0)};
+	};
+	auto reference = run_with(ppl::execution_mode::serial, false);
+	REQUIRE(reference.first == std::vector<int>{16, 20, 24, 28, 32});
+	REQUIRE(reference.second == 5 * 12);
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::work_stealing})
+	{
+		REQUIRE(run_with(mode, true) == reference);
+		REQUIRE(run_with(mode, false) == reference);
+	}
+}
+
+TEST_CASE("run_for, run_until and run_budget stop at their bound or once every sink is closed"){
+	std::vector<int> out{};
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>(10);
+	p.connect(src, p.create_node<recording_sink>(&out), 0);
+
+	auto partial = p.run_for(4);
+	REQUIRE(partial.ticks == 4);
+	REQUIRE_FALSE(partial.closed);
+	REQUIRE(out == std::vector<int>{1, 2, 3, 4});
+
+	auto past = p.run_until(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+	REQUIRE(past.ticks == 0);
+	REQUIRE(out.size() == 4);
+
+	auto rest = p.run_budget(std::chrono::minutes(1));
+	REQUIRE(rest.closed);
+	REQUIRE(rest.ticks == 7); // six values and the closing tick
+	REQUIRE(rest.elapsed < std::chrono::minutes(1));
+	REQUIRE(out.size() == 10);
+
+	auto after = p.run_for(100);
+	REQUIRE(after.ticks == 1);
+	REQUIRE(after.closed);
+}
+
+TEST_CASE("stats: polls and outcomes are counted per node only while enabled"){
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::streaming, ppl::execution_mode::work_stealing})
+	{
+		ppl::pipeline p{};
+		std::vector<int> out{};
+		auto src = p.create_node<every_other_source>();
+		auto inc = p.create_node<add_one>();
+		auto sink = p.create_node<recording_sink>(&out);
+		p.connect(src, inc, 0);
+		p.connect(inc, sink, 0);
+
+		p.run_for(2); // not collecting yet
+		REQUIRE(p.stats(src).polls == 0);
+
+		auto options = ppl::run_options{mode, 2};
+		options.collect_stats = true;
+		p.set_options(options);
+		p.run();
+		auto& source_stats = p.stats(src);
+		REQUIRE(source_stats.polls == 9);
+		REQUIRE(source_stats.ready == 4);
+		REQUIRE(source_stats.empty == 4);
+		REQUIRE(source_stats.closed == 1);
+		auto histogram_total = std::uint64_t{0};
+		for (auto count : source_stats.latency_histogram){
+			histogram_total += count;
+		}
+		REQUIRE(histogram_total == 9);
+		REQUIRE(p.stats(inc).polls == 4); // only ticks on which the source was ready
+		REQUIRE(p.stats(inc).ready == 4);
+
+		auto all = p.stats();
+		REQUIRE(all.size() == 3);
+		REQUIRE(all[1].first == inc);
+		p.reset_stats();
+		REQUIRE(p.stats(sink).polls == 0);
+		REQUIRE_THROWS_AS(p.stats(ppl::pipeline::node_id{12345}), ppl::pipeline_error);
+	}
+}
+
+TEST_CASE("stats: nodes created after collecting starts are counted too"){
+	ppl::pipeline p{};
+	auto options = ppl::run_options{};
+	options.collect_stats = true;
+	p.set_options(options); // before there is any node to count
+	std::vector<int> out{};
+	auto src = p.create_node<every_other_source>();
+	auto sink = p.create_node<recording_sink>(&out);
+	p.connect(src, sink, 0);
+	p.run();
+	REQUIRE(p.stats(src).polls == 11);
+	REQUIRE(p.stats(sink).polls == 5);
+
+	p.erase_node(sink);
+	auto reused = p.create_node<recording_sink>(&out); // takes the erased sink's slot
+	REQUIRE(p.stats(reused).polls == 0);
+	REQUIRE(p.stats().size() == 2);
+}
+
+TEST_CASE("trace: ticks and polls are written as Chrome trace events"){
+	auto path = (std::filesystem::temp_directory_path() / "pipeline_trace_test.json").string();
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::streaming, ppl::execution_mode::work_stealing}){
+		{
+			ppl::pipeline p{};
+			p.set_options({mode, 2});
+			std::vector<int> out{};
+			// the source reuses the erased node's slot, so its ID and the number operator<< shows for it differ
+			p.erase_node(p.create_node<add_one>());
+			auto src = p.create_node<every_other_source>();
+			auto inc = p.create_node<add_one>();
+			p.connect(src, inc, 0);
+			p.connect(inc, p.create_node<recording_sink>(&out), 0);
+			auto dot = std::ostringstream{};
+			dot << p;
+			REQUIRE(dot.str().find("\"2 EveryOtherSource\" -> \"3 AddOne\"") != std::string::npos);
+			p.start_trace(path);
+			p.run();
+		} // destroying the pipeline completes the file
+
+		auto file = std::ifstream{path};
+		auto contents = std::ostringstream{};
+		contents << file.rdbuf();
+		auto text = contents.str();
+		auto count = [&text](std::string_view needle) {
+			auto n = 0;
+			for (auto at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)){
+				++n;
+			}
+			return n;
+		};
+		REQUIRE(text.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+		REQUIRE(text.ends_with("\n]}\n"));
+		// the source is polled 11 times, add_one and the sink 5 times each
+		REQUIRE(count("\"cat\":\"poll\"") == 11 + 5 + 5);
+		REQUIRE(count("\"name\":\"2 EveryOtherSource\"") == 11);
+		REQUIRE(count("\"poll\":\"empty\"") == 5);
+		REQUIRE(count("\"name\":\"3 AddOne\",\"cat\":\"poll\"") == 5);
+		if (mode == ppl::execution_mode::streaming){
+			REQUIRE(count("\"name\":\"streaming run\"") == 1);
+		}
+		else {
+			REQUIRE(count("\"cat\":\"tick\"") == 11);
+			REQUIRE(count("\"name\":\"tick 11\"") == 1);
+		}
+	}
+	std::filesystem::remove(path);
+
+	ppl::pipeline p{};
+	REQUIRE_THROWS_AS(p.start_trace("/nonexistent-directory/trace.json"), std::runtime_error);
+}
+
+// Forwards to the default resource, counting what passes through.
+struct counting_resource : std::pmr::memory_resource {
+	std::size_t allocations = 0;
+	std::size_t live_bytes = 0;
+
+ private:
+	auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override {
+		++allocations;
+		live_bytes += bytes;
+		return std::pmr::get_default_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+		live_bytes -= bytes;
+		std::pmr::get_default_resource()->deallocate(p, bytes, alignment);
+	}
+	auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override {
+		return this == &other;
+	}
+};
+
+TEST_CASE("memory_resource: nodes and their edge lists come from the pipeline's resource"){
+	SECTION("everything is returned when nodes are erased or the pipeline is destroyed"){
+		auto resource = counting_resource{};
+		{
+			ppl::pipeline p{&resource};
+			std::vector<int> out{};
+			auto src = p.create_node<counting_source>(3);
+			auto inc = p.create_node<add_one>();
+			p.connect(src, inc, 0);
+			p.connect(inc, p.create_node<recording_sink>(&out), 0);
+			REQUIRE(resource.allocations >= 3);
+			p.run();
+			REQUIRE(out == std::vector<int>{2, 3, 4});
+
+			auto before = resource.live_bytes;
+			p.erase_node(inc);
+			REQUIRE(resource.live_bytes < before);
+
+			// the resource moves with the nodes
+			auto q = std::move(p);
+			q.create_node<add_one>();
+		}
+		REQUIRE(resource.live_bytes == 0);
+	}
+
+	SECTION("a monotonic arena builds a large graph with a handful of upstream allocations"){
+		auto upstream = counting_resource{};
+		auto arena = std::pmr::monotonic_buffer_resource{&upstream};
+		ppl::pipeline p{&arena};
+		std::vector<int> out{};
+		auto last = p.create_node<counting_source>(2);
+		for (auto i = 0; i < 50000; ++i){
+			auto next = p.create_node<add_one>();
+			p.connect(last, next, 0);
+			last = next;
+		}
+		p.connect(last, p.create_node<recording_sink>(&out), 0);
+		p.run();
+		REQUIRE(out == std::vector<int>{50001, 50002});
+		REQUIRE(upstream.allocations < 64);
+	}
+}
+
+// Reads its inputs through the typed slots of component, without overriding connect().
+struct typed_concat : ppl::component<std::tuple<int, std::string>, std::string> {
+	std::string current_value{};
+	auto name() const -> std::string override {
+		return "TypedConcat";
+	}
+	auto poll_next() -> ppl::poll override {
+		current_value = input<1>() + std::to_string(input<0>());
+		return ppl::poll::ready;
+	}
+	auto value() const -> const std::string& override {
+		return current_value;
+	}
+};
+
+struct typed_string_sink : ppl::sink<std::string> {
+	std::vector<std::string>* out;
+	explicit typed_string_sink(std::vector<std::string>* out_) : out(out_) {}
+	auto name() const -> std::string override {
+		return "TypedStringSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		out->push_back(input<0>());
+		return ppl::poll::ready;
+	}
+};
+
+struct label_source : ppl::source<std::string> {
+	std::string label = "n";
+	auto name() const -> std::string override {
+		return "LabelSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		return ppl::poll::ready;
+	}
+	auto value() const -> const std::string& override {
+		return label;
+	}
+};
+
+TEST_CASE("component: the default connect() binds typed slots read through input<I>()"){
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::streaming}){
+		ppl::pipeline p{};
+		p.set_options({mode});
+		std::vector<std::string> out{};
+		auto numbers = p.create_node<counting_source>(3);
+		auto labels = p.create_node<label_source>();
+		auto concat = p.create_node<typed_concat>();
+		p.connect(numbers, concat, 0);
+		p.connect(labels, concat, 1);
+		p.connect(concat, p.create_node<typed_string_sink>(&out), 0);
+		p.run();
+		REQUIRE(out == std::vector<std::string>{"n1", "n2", "n3"});
+
+		auto& node = dynamic_cast<typed_concat&>(*p.get_node(concat));
+		REQUIRE(node.input_source<0>() == p.get_node(numbers));
+		p.disconnect(labels, concat);
+		REQUIRE(node.input_source<1>() == nullptr);
+		REQUIRE(node.input_source<0>() != nullptr);
+	}
+}
+
+// A payload that counts how often it is deep-copied.
+struct tracked_buffer {
+	std::vector<int> data{};
+	std::atomic<int>* copies = nullptr;
+	tracked_buffer() = default;
+	tracked_buffer(std::vector<int> data_, std::atomic<int>* copies_) : data(std::move(data_)), copies(copies_) {}
+	tracked_buffer(const tracked_buffer& other) : data(other.data), copies(other.copies) {
+		++*copies;
+	}
+	tracked_buffer(tracked_buffer&&) noexcept = default;
+	auto operator=(const tracked_buffer& other) -> tracked_buffer& {
+		data = other.data;
+		copies = other.copies;
+		++*copies;
+		return *this;
+	}
+	auto operator=(tracked_buffer&&) noexcept -> tracked_buffer& = default;
+	~tracked_buffer() = default;
+	friend auto operator==(const tracked_buffer& a, const tracked_buffer& b) -> bool {
+		return a.data == b.data;
+	}
+};
+
+struct buffer_source : ppl::source<tracked_buffer> {
+	tracked_buffer current{};
+	int produced = 0;
+	std::atomic<int>* copies;
+	explicit buffer_source(std::atomic<int>* copies_) : copies(copies_) {}
+	auto name() const -> std::string override {
+		return "BufferSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		if (produced == 3) return ppl::poll::closed;
+		current = tracked_buffer{std::vector<int>(1000, ++produced), copies};
+		return ppl::poll::ready;
+	}
+	auto value() const -> const tracked_buffer& override {
+		return current;
+	}
+	auto take_value() -> tracked_buffer override {
+		return std::move(current);
+	}
+};
+
+struct buffer_sink : ppl::sink<tracked_buffer> {
+	std::vector<tracked_buffer>* out;
+	explicit buffer_sink(std::vector<tracked_buffer>* out_) : out(out_) {}
+	auto name() const -> std::string override {
+		return "BufferSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		out->push_back(take<0>());
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("take: a sole consumer moves its input out, shared inputs are copied"){
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::streaming}){
+		std::atomic<int> copies{0}; // the two sinks copy on their own threads when streaming
+		std::vector<tracked_buffer> first{};
+		std::vector<tracked_buffer> second{};
+		ppl::pipeline p{};
+		p.set_options({mode});
+		auto src = p.create_node<buffer_source>(&copies);
+		auto sink = p.create_node<buffer_sink>(&first);
+		p.connect(src, sink, 0);
+		p.run();
+		REQUIRE(first.size() == 3);
+		REQUIRE(first.back().data == std::vector<int>(1000, 3));
+		REQUIRE(copies == 0);
+
+		// a second consumer makes the edge shared once the plan is rebuilt
+		p.erase_node(src);
+		first.clear();
+		src = p.create_node<buffer_source>(&copies);
+		p.connect(src, sink, 0);
+		p.connect(src, p.create_node<buffer_sink>(&second), 0);
+		p.run();
+		REQUIRE(first.size() == 3);
+		REQUIRE(second == first);
+		REQUIRE(copies > 0);
+	}
+}
+
+TEST_CASE("shared_value: copies share the value until one of them mutates it"){
+	auto a = ppl::make_shared_value<std::vector<int>>(3, 7);
+	auto b = a;
+	REQUIRE(a.use_count() == 2);
+	REQUIRE(&*a == &*b);
+	REQUIRE(a == b);
+
+	b.mutate().push_back(8);
+	REQUIRE(a.unique());
+	REQUIRE(b.unique());
+	REQUIRE(*a == std::vector<int>{7, 7, 7});
+	REQUIRE(*b == std::vector<int>{7, 7, 7, 8});
+
+	auto data = b->data();
+	auto moved = std::move(b).take();
+	REQUIRE(moved.data() == data); // the last handle gives its value up without a copy
+}
+
+struct broadcast_source : ppl::source<std::vector<int>> {
+	ppl::shared_value<std::vector<int>> current{};
+	int produced = 0;
+	auto name() const -> std::string override {
+		return "BroadcastSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		if (produced == 2) return ppl::poll::closed;
+		current = ppl::shared_value<std::vector<int>>(std::vector<int>(1000, ++produced));
+		return ppl::poll::ready;
+	}
+	auto value() const -> const std::vector<int>& override {
+		return *current;
+	}
+	auto shared() const -> ppl::shared_value<std::vector<int>> override {
+		return current;
+	}
+};
+
+struct retaining_sink : ppl::sink<std::vector<int>> {
+	std::vector<ppl::shared_value<std::vector<int>>> kept{};
+	bool stamp;
+	explicit retaining_sink(bool stamp_) : stamp(stamp_) {}
+	auto name() const -> std::string override {
+		return "RetainingSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		kept.push_back(share<0>());
+		if (stamp){
+			kept.back().mutate().front() = -1;
+		}
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("share: fan-out consumers keep one copy of each value, a writer gets its own"){
+	ppl::pipeline p{};
+	auto src = p.create_node<broadcast_source>();
+	auto readers = std::vector<ppl::pipeline::node_id>{};
+	for (auto i = 0; i < 5; ++i){
+		readers.push_back(p.create_node<retaining_sink>(false));
+		p.connect(src, readers.back(), 0);
+	}
+	auto writer = p.create_node<retaining_sink>(true);
+	p.connect(src, writer, 0);
+	p.run();
+
+	auto& first = static_cast<retaining_sink*>(p.get_node(readers.front()))->kept;
+	REQUIRE(first.size() == 2);
+	for (auto id : readers){
+		auto& kept = static_cast<retaining_sink*>(p.get_node(id))->kept;
+		REQUIRE(kept.size() == 2);
+		REQUIRE(&*kept[0] == &*first[0]);
+		REQUIRE(&*kept[1] == &*first[1]);
+	}
+	REQUIRE(first[0].use_count() == 5);
+	REQUIRE(first[1].use_count() == 6); // still held by the source too
+	REQUIRE(first[1]->front() == 2);
+
+	auto& written = static_cast<retaining_sink*>(p.get_node(writer))->kept;
+	REQUIRE(written[1]->front() == -1);
+	REQUIRE(&*written[1] != &*first[1]);
+}
+
+struct keeping_sink : ppl::sink<int> {
+	std::vector<ppl::shared_value<int>> kept{};
+	auto name() const -> std::string override {
+		return "KeepingSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		kept.push_back(share<0>());
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("share: producers of plain values hand out a copy"){
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>(1);
+	auto sink = p.create_node<keeping_sink>();
+	p.connect(src, sink, 0);
+	p.run();
+	auto& kept = static_cast<keeping_sink*>(p.get_node(sink))->kept;
+	REQUIRE(kept.size() == 1);
+	REQUIRE(*kept[0] == 1);
+	REQUIRE(kept[0].unique());
+}
+
+TEST_CASE("pipeline_builder: commit() wires and checks the staged graph once"){
+	std::vector<int> out{};
+	auto builder = ppl::pipeline_builder{};
+	builder.reserve(4, 4);
+	auto src = builder.create_node<counting_source>(3);
+	auto left = builder.create_node<add_one>();
+	auto right = builder.create_node<add_one>();
+	auto sum = builder.create_node<sum_two>();
+	auto sink = builder.create_node<recording_sink>(&out);
+	builder.connect(src, left, 0);
+	builder.connect(src, right, 0);
+	builder.connect(left, sum, 0);
+	builder.connect(right, sum, 1);
+	builder.connect(sum, sink, 0);
+
+	ppl::pipeline p{};
+	p.set_options({ppl::execution_mode::work_stealing});
+	builder.commit(p);
+	REQUIRE(p.is_valid());
+	REQUIRE(p.options().mode == ppl::execution_mode::work_stealing);
+	REQUIRE(p.get_dependencies(src) == std::vector<std::pair<ppl::pipeline::node_id, int>>{{left, 0}, {right, 0}});
+	p.run();
+	REQUIRE(out == std::vector<int>{4, 6, 8});
+}
+
+TEST_CASE("pipeline_builder: a failed commit() leaves the target unchanged"){
+	std::vector<int> out{};
+	ppl::pipeline p{};
+	auto kept = p.create_node<counting_source>(1);
+	p.connect(kept, p.create_node<recording_sink>(&out), 0);
+	auto before = std::ostringstream{};
+	before << p;
+
+	auto check_unchanged = [&] {
+		auto after = std::ostringstream{};
+		after << p;
+		REQUIRE(after.str() == before.str());
+		REQUIRE(p.is_valid());
+	};
+
+	SECTION("a bad edge"){
+		auto builder = ppl::pipeline_builder{};
+		auto src = builder.create_node<counting_source>();
+		std::vector<std::string> strings{};
+		builder.connect(src, builder.create_node<typed_string_sink>(&strings), 0);
+		try {
+			builder.commit(p);
+			FAIL();
+		} catch (ppl::pipeline_error& e) {
+			REQUIRE(e.kind() == ppl::pipeline_error_kind::connection_type_mismatch);
+		}
+		check_unchanged();
+	}
+	SECTION("an invalid graph"){
+		auto builder = ppl::pipeline_builder{};
+		auto src = builder.create_node<counting_source>();
+		builder.create_node<add_one>(); // its slot is never filled
+		builder.connect(src, builder.create_node<recording_sink>(&out), 0);
+		REQUIRE_THROWS_AS(builder.commit(p), std::runtime_error);
+		check_unchanged();
+	}
+}
+
+// Sinks are restored writing into out, whatever they wrote into when saved.
+auto snapshot_test_registry(std::vector<int>* out) -> ppl::snapshot_registry {
+	auto registry = ppl::snapshot_registry{};
+	registry.add<counting_source>(
+	   "counting_source",
+	   [](const counting_source& n, ppl::snapshot_writer& w) { w.write(n.limit); },
+	   [](ppl::snapshot_reader& r) { return std::tuple{r.read<int>()}; });
+	registry.add<add_one>(
+	   "add_one",
+	   [](const add_one&, ppl::snapshot_writer&) {},
+	   [](ppl::snapshot_reader&) { return std::tuple{}; });
+	registry.add<sum_two>(
+	   "sum_two",
+	   [](const sum_two&, ppl::snapshot_writer&) {},
+	   [](ppl::snapshot_reader&) { return std::tuple{}; });
+	registry.add<recording_sink>(
+	   "recording_sink",
+	   [](const recording_sink&, ppl::snapshot_writer&) {},
+	   [out](ppl::snapshot_reader&) { return std::tuple{out}; });
+	return registry;
+}
+
+auto as_bytes(const std::string& text) -> std::span<const std::byte> {
+	return std::as_bytes(std::span{text.data(), text.size()});
+}
+
+TEST_CASE("snapshot: a loaded pipeline has the same nodes, IDs and edges and runs the same"){
+	std::vector<int> out{};
+	std::vector<int> restored_out{};
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>(4);
+	p.erase_node(p.create_node<add_one>()); // leaves a free slot and a stale generation behind
+	auto left = p.create_node<add_one>();
+	auto right = p.create_node<add_one>();
+	auto sum = p.create_node<sum_two>();
+	p.connect(src, left, 0);
+	p.connect(src, right, 0);
+	p.connect(left, sum, 0);
+	p.connect(right, sum, 1);
+	p.connect(sum, p.create_node<recording_sink>(&out), 0);
+
+	auto saved = std::ostringstream{};
+	ppl::save_snapshot(saved, p, snapshot_test_registry(&out));
+	auto bytes = saved.str();
+	auto q = ppl::load_snapshot(as_bytes(bytes), snapshot_test_registry(&restored_out));
+
+	auto expected = std::ostringstream{};
+	expected << p;
+	auto actual = std::ostringstream{};
+	actual << q;
+	REQUIRE(actual.str() == expected.str());
+	REQUIRE(q.get_dependencies(src) == p.get_dependencies(src));
+	REQUIRE(q.is_valid());
+	// the next node reuses the same slot in both
+	auto extra = p.create_node<add_one>();
+	REQUIRE(q.create_node<add_one>() == extra);
+	p.erase_node(extra);
+	q.erase_node(extra);
+
+	p.run();
+	q.run();
+	REQUIRE(out == std::vector<int>{4, 6, 8, 10});
+	REQUIRE(restored_out == out);
+}
+
+TEST_CASE("snapshot: unknown types and damaged data are rejected"){
+	std::vector<int> out{};
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>();
+	p.connect(src, p.create_node<recording_sink>(&out), 0);
+	auto saved = std::ostringstream{};
+	ppl::save_snapshot(saved, p, snapshot_test_registry(&out));
+	auto bytes = saved.str();
+
+	auto sources_only = ppl::snapshot_registry{};
+	sources_only.add<counting_source>(
+	   "counting_source",
+	   [](const counting_source& n, ppl::snapshot_writer& w) { w.write(n.limit); },
+	   [](ppl::snapshot_reader& r) { return std::tuple{r.read<int>()}; });
+	auto ignored = std::ostringstream{};
+	REQUIRE_THROWS_AS(ppl::save_snapshot(ignored, p, sources_only), std::runtime_error);
+	REQUIRE_THROWS_AS(ppl::load_snapshot(as_bytes(bytes), sources_only), std::runtime_error);
+
+	auto registry = snapshot_test_registry(&out);
+	REQUIRE_THROWS_AS(ppl::load_snapshot(as_bytes(bytes.substr(0, bytes.size() - 1)), registry), std::runtime_error);
+	REQUIRE_THROWS_AS(ppl::load_snapshot(as_bytes("not a snapshot"), registry), std::runtime_error);
+}
+
+TEST_CASE("snapshot: damaged edges, orders and counts are rejected rather than run"){
+	std::vector<int> out{};
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>(4);
+	p.erase_node(p.create_node<add_one>());
+	auto left = p.create_node<add_one>();
+	auto right = p.create_node<add_one>();
+	auto sum = p.create_node<sum_two>();
+	p.connect(src, left, 0);
+	p.connect(src, right, 0);
+	p.connect(left, sum, 0);
+	p.connect(right, sum, 1);
+	p.connect(sum, p.create_node<recording_sink>(&out), 0);
+	auto saved = std::ostringstream{};
+	ppl::save_snapshot(saved, p, snapshot_test_registry(&out));
+	auto bytes = saved.str();
+
+	// whatever a damaged byte turns into, it either fails to load or loads a graph that runs
+	auto registry = snapshot_test_registry(&out);
+	auto rejected = 0;
+	for (auto i = 0u; i < bytes.size(); ++i){
+		for (auto flip : {1, 0x80, 0xff}){
+			auto damaged = bytes;
+			damaged[i] = static_cast<char>(damaged[i] ^ flip);
+			try {
+				auto q = ppl::load_snapshot(as_bytes(damaged), registry);
+				if (q.is_valid()){
+					q.run_for(8);
+				}
+			} catch (std::runtime_error&) {
+				++rejected;
+			}
+		}
+	}
+	REQUIRE(rejected > 0);
+}
+
+struct checked_source : counting_source {
+	explicit checked_source(int limit_) : counting_source(limit_) {
+		if (limit_ < 0){
+			throw std::out_of_range("limit must not be negative");
+		}
+	}
+};
+
+auto factory_test_registry(std::vector<int>* out) -> ppl::node_factory {
+	auto factory = ppl::node_factory{};
+	factory.add<counting_source, int>("counting_source");
+	factory.add<checked_source, int>("checked_source");
+	factory.add<add_one>("add_one");
+	factory.add<sum_two>("sum_two");
+	factory.add<recording_sink>("recording_sink", [out](std::span<const std::string_view>) { return std::tuple{out}; });
+	return factory;
+}
+
+TEST_CASE("load_pipeline: builds the graph a config describes"){
+	std::vector<int> out{};
+	auto config = std::istringstream{R"(# a diamond
+node src counting_source 3
+node left add_one
+node right add_one
+node sum sum_two
+
+node sink recording_sink
+edge src left 0
+edge src right 0
+edge left sum 0
+  edge right   sum 1
+edge sum sink 0
+)"};
+	ppl::pipeline p{};
+	ppl::load_pipeline(config, factory_test_registry(&out), p);
+	REQUIRE(p.is_valid());
+	// nodes are numbered in the order they are listed
+	REQUIRE(p.get_dependencies(1) == std::vector<std::pair<ppl::pipeline::node_id, int>>{{2, 0}, {3, 0}});
+	p.run();
+	REQUIRE(out == std::vector<int>{4, 6, 8});
+}
+
+TEST_CASE("load_pipeline: a bad config names its line and leaves the target unchanged"){
+	std::vector<int> out{};
+	auto factory = factory_test_registry(&out);
+	ppl::pipeline p{};
+	auto src = p.create_node<counting_source>();
+	auto sink = p.create_node<recording_sink>(&out);
+	p.connect(src, sink, 0);
+
+	auto error_for = [&](const std::string& text) {
+		auto config = std::istringstream{text};
+		try {
+			ppl::load_pipeline(config, factory, p);
+		} catch (std::runtime_error& e) {
+			return std::string{e.what()};
+		}
+		return std::string{};
+	};
+	auto good = std::string{"node src counting_source 3\nnode sink recording_sink\n"};
+	CHECK(error_for(good + "node x no_such_type\n") == "config line 3: no node type no_such_type");
+	CHECK(error_for("node src counting_source three\n") == "config line 1: expected a number, not three");
+	CHECK(error_for("node src counting_source\n") == "config line 1: expected 1 arguments, not 0");
+	CHECK(error_for("node src checked_source -1\n") == "config line 1: limit must not be negative");
+	CHECK(error_for(good + "node src add_one\n") == "config line 3: node src is already defined");
+	CHECK(error_for(good + "edge src nowhere 0\n") == "config line 3: no node labelled nowhere");
+	CHECK(error_for(good + "edge src sink\n") == "config line 3: expected edge <src label> <dst label> <slot>");
+	CHECK(error_for(good + "connect src sink 0\n") == "config line 3: unknown directive connect");
+	CHECK(error_for(good) == "pipeline_builder: the staged graph is not valid");
+
+	auto config = std::istringstream{good + "edge src sink 1\n"};
+	REQUIRE_THROWS_AS(ppl::load_pipeline(config, factory, p), ppl::pipeline_error);
+	REQUIRE(p.get_dependencies(src) == std::vector<std::pair<ppl::pipeline::node_id, int>>{{sink, 0}});
+	REQUIRE(p.is_valid());
+}
+
+// in -> add_one -> add_one, the output; adds two to every value
+auto add_two_fragment() -> std::tuple<ppl::pipeline, ppl::pipeline::node_id, ppl::pipeline::node_id> {
+	ppl::pipeline fragment{};
+	auto in = fragment.create_node<ppl::composite_input<int>>();
+	auto first = fragment.create_node<add_one>();
+	auto second = fragment.create_node<add_one>();
+	fragment.connect(in, first, 0);
+	fragment.connect(first, second, 0);
+	return {std::move(fragment), in, second};
+}
+
+using add_two = ppl::composite<std::tuple<int>, int>;
+
+TEST_CASE("composite: fragments run flattened into the parent plan in every mode"){
+	auto run_with = [](ppl::execution_mode mode) {
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{mode, 3});
+		std::vector<int> out{};
+		auto src = p.create_node<counting_source>(3);
+		auto [f1, in1, out1] = add_two_fragment();
+		auto first = p.create_node<add_two>(std::move(f1), std::array{in1}, out1);
+
+		// a composite of composites, fed twice: (x + 2) + (x + 2 + 2)
+		ppl::pipeline outer{};
+		auto in = outer.create_node<ppl::composite_input<int>>();
+		auto [f2, in2, out2] = add_two_fragment();
+		auto [f3, in3, out3] = add_two_fragment();
+		auto inner = outer.create_node<add_two>(std::move(f2), std::array{in2}, out2);
+		auto again = outer.create_node<add_two>(std::move(f3), std::array{in3}, out3);
+		auto sum = outer.create_node<sum_two>();
+		outer.connect(in, inner, 0);
+		outer.connect(inner, again, 0);
+		outer.connect(inner, sum, 0);
+		outer.connect(again, sum, 1);
+		auto nested = p.create_node<add_two>(std::move(outer), std::array{in}, sum);
+
+		auto sink = p.create_node<recording_sink>(&out);
+		p.connect(src, first, 0);
+		p.connect(first, nested, 0);
+		p.connect(nested, sink, 0);
+		REQUIRE(p.is_valid());
+		p.run();
+		return out;
+	};
+	// 1, 2, 3 -> 3, 4, 5 -> 12, 14, 16
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::streaming, ppl::execution_mode::work_stealing})
+	{
+		auto out = run_with(mode);
+		REQUIRE(out.size() >= 3);
+		REQUIRE(std::vector<int>(out.begin(), out.begin() + 3) == std::vector<int>{12, 14, 16});
+	}
+}
+
+TEST_CASE("composite: inner nodes count their polls in the fragment and are drawn as clusters"){
+	ppl::pipeline p{};
+	auto options = ppl::run_options{};
+	options.collect_stats = true;
+	p.set_options(options);
+	std::vector<int> out{};
+	auto src = p.create_node<counting_source>(3);
+	auto [fragment, in, output] = add_two_fragment();
+	auto mid = p.create_node<add_two>(std::move(fragment), std::array{in}, output);
+	auto sink = p.create_node<recording_sink>(&out);
+	p.connect(src, mid, 0);
+	p.connect(mid, sink, 0);
+	p.run();
+	REQUIRE(std::vector<int>(out.begin(), out.begin() + 3) == std::vector<int>{3, 4, 5});
+
+	auto& inner = dynamic_cast<const add_two&>(*p.get_node(mid)).fragment();
+	REQUIRE(inner.stats(output).ready == 3);
+	REQUIRE(p.stats(mid).polls == 0);
+	p.reset_stats();
+	REQUIRE(inner.stats(output).polls == 0);
+
+	auto dot = std::ostringstream{};
+	p.print_clusters(dot);
+	REQUIRE(dot.str() == R"(digraph G {
+  "1 CountingSource"
+  "2 composite"
+  "3 RecordingSink"
+
+  "1 CountingSource" -> "2 composite"
+  "2 composite" -> "3 RecordingSink"
+  subgraph "cluster_2" {
+    label="2 composite"
+    "2.1 input"
+    "2.2 AddOne"
+    "2.3 AddOne"
+
+    "2.1 input" -> "2.2 AddOne"
+    "2.2 AddOne" -> "2.3 AddOne"
+  }
+}
+)");
+}
+
+TEST_CASE("composite: fragments that cannot stand in for a node are rejected"){
+	auto [fragment, in, output] = add_two_fragment();
+	// the output is not a producer of the composite's output type
+	auto [f1, in1, out1] = add_two_fragment();
+	REQUIRE_THROWS_AS((ppl::composite<std::tuple<int>, std::string>(std::move(f1), {in1}, out1)), std::invalid_argument);
+	// the input is not a placeholder
+	auto [f2, in2, out2] = add_two_fragment();
+	REQUIRE_THROWS_AS(add_two(std::move(f2), {out2}, out2), std::invalid_argument);
+	// a node besides the output has no dependent
+	auto [f3, in3, out3] = add_two_fragment();
+	f3.create_node<add_one>();
+	REQUIRE_THROWS_AS(add_two(std::move(f3), {in3}, out3), std::invalid_argument);
+	// a slot besides the placeholder's is left unconnected
+	auto [f4, in4, out4] = add_two_fragment();
+	f4.connect(out4, f4.create_node<recording_sink>(nullptr), 0);
+	auto loose = f4.create_node<add_one>();
+	f4.connect(loose, f4.create_node<recording_sink>(nullptr), 0);
+	REQUIRE_THROWS_AS(add_two(std::move(f4), {in4}, out4), std::invalid_argument);
+	// the placeholder is fed from within the fragment
+	auto [f5, in5, out5] = add_two_fragment();
+	f5.connect(f5.create_node<counting_source>(), in5, 0);
+	REQUIRE_THROWS_AS(add_two(std::move(f5), {in5}, out5), std::invalid_argument);
+
+	REQUIRE_NOTHROW(add_two(std::move(fragment), {in}, output));
+}
+
+struct gated_source : ppl::source<int> {
+	const std::atomic<bool>* stop;
+	int current_value = 0;
+	explicit gated_source(const std::atomic<bool>* stop_) : stop(stop_) {}
+	auto name() const -> std::string override {
+		return "GatedSource";
+	}
+	auto poll_next() -> ppl::poll override {
+		if (stop->load()) {
+			return ppl::poll::closed;
+		}
+		++current_value;
+		return ppl::poll::ready;
+	}
+	auto value() const -> const int& override {
+		return current_value;
+	}
+};
+
+struct watched_sink : ppl::sink<int> {
+	std::atomic<int>* seen;
+	std::atomic<bool>* destroyed;
+	watched_sink(std::atomic<int>* seen_, std::atomic<bool>* destroyed_) : seen(seen_), destroyed(destroyed_) {}
+	~watched_sink() override {
+		destroyed->store(true);
+	}
+	auto name() const -> std::string override {
+		return "WatchedSink";
+	}
+	auto poll_next() -> ppl::poll override {
+		static_cast<void>(this->input<0>());
+		++*seen;
+		return ppl::poll::ready;
+	}
+};
+
+TEST_CASE("reconfiguration: branches are added and erased from another thread while run() executes"){
+	// waits for condition, or fails after a generous timeout rather than hanging the test run
+	auto eventually = [](auto condition) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+		while (!condition() && std::chrono::steady_clock::now() < deadline){
+			std::this_thread::yield();
+		}
+		return condition();
+	};
+	for (auto mode : {ppl::execution_mode::serial, ppl::execution_mode::level_parallel,
+	                  ppl::execution_mode::work_stealing})
+	{
+		ppl::pipeline p{};
+		p.set_options(ppl::run_options{mode, 2});
+		auto stop = std::atomic<bool>{false};
+		auto seen = std::array<std::atomic<int>, 3>{};
+		auto destroyed = std::array<std::atomic<bool>, 3>{};
+		auto src = p.create_node<gated_source>(&stop);
+		auto kept = p.create_node<watched_sink>(&seen[0], &destroyed[0]);
+		auto old_mid = p.create_node<add_one>();
+		auto old_sink = p.create_node<watched_sink>(&seen[1], &destroyed[1]);
+		p.connect(src, kept, 0);
+		p.connect(src, old_mid, 0);
+		p.connect(old_mid, old_sink, 0);
+
+		auto error = std::exception_ptr{};
+		auto runner = std::jthread{[&p, &error] {
+			try {
+				p.run();
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}};
+		REQUIRE(eventually([&] { return seen[1].load() > 0; }));
+
+		// each change leaves the graph invalid until its last call, so the run only ever ticks complete graphs
+		auto new_mid = p.create_node<add_one>();
+		auto new_sink = p.create_node<watched_sink>(&seen[2], &destroyed[2]);
+		p.connect(new_mid, new_sink, 0);
+		p.connect(src, new_mid, 0);
+		REQUIRE(eventually([&] { return seen[2].load() > 0; }));
+
+		p.erase_node(old_sink);
+		p.erase_node(old_mid);
+		// reclaimed once a plan without them is in use, while the run goes on
+		REQUIRE(eventually([&] { return destroyed[1].load(); }));
+		auto before = seen[0].load();
+		REQUIRE(eventually([&] { return seen[0].load() > before; }));
+
+		stop = true;
+		runner.join();
+		REQUIRE_FALSE(error);
+		REQUIRE_FALSE(destroyed[0].load());
+		REQUIRE_FALSE(destroyed[2].load());
+		REQUIRE(p.is_valid());
+		REQUIRE(p.get_dependencies(src) == std::vector<std::pair<ppl::pipeline::node_id, int>>{{kept, 0}, {new_mid, 0}});
+	}
+}
+
+TEST_CASE("reconfiguration: changes made under reconfigure() reach a running pipeline together"){
+	auto eventually = [](auto condition) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+		while (!condition() && std::chrono::steady_clock::now() < deadline){
+			std::this_thread::yield();
+		}
+		return condition();
+	};
+	ppl::pipeline p{};
+	auto stop = std::atomic<bool>{false};
+	auto seen = std::array<std::atomic<int>, 2>{};
+	auto destroyed = std::array<std::atomic<bool>, 2>{};
+	auto src = p.create_node<gated_source>(&stop);
+	auto old_sink = p.create_node<watched_sink>(&seen[0], &destroyed[0]);
+	p.connect(src, old_sink, 0);
+	auto runner = std::jthread{[&p] { p.run(); }};
+	REQUIRE(eventually([&] { return seen[0].load() > 0; }));
+
+	{
+		// swapping sinks leaves a valid graph after every call, yet the run sees neither half on its own
+		auto edit = p.reconfigure();
+		auto new_sink = p.create_node<watched_sink>(&seen[1], &destroyed[1]);
+		p.connect(src, new_sink, 0);
+		auto before = seen[0].load();
+		REQUIRE(eventually([&] { return seen[0].load() > before + 100; }));
+		REQUIRE(seen[1].load() == 0);
+		p.erase_node(old_sink);
+		REQUIRE_FALSE(destroyed[0].load());
+	}
+	REQUIRE(eventually([&] { return seen[1].load() > 0; }));
+	REQUIRE(eventually([&] { return destroyed[0].load(); }));
+
+	stop = true;
+	runner.join();
+	REQUIRE_FALSE(destroyed[1].load());
+}
+
+TEST_CASE("reconfiguration: threads creating nodes at once share a resource that is not thread-safe"){
+	auto resource = std::pmr::unsynchronized_pool_resource{};
+	ppl::pipeline p{&resource};
+	auto ids = std::array<std::vector<ppl::pipeline::node_id>, 4>{};
+	{
+		auto threads = std::vector<std::jthread>{};
+		for (auto& mine : ids){
+			threads.emplace_back([&p, &mine] {
+				for (auto k = 0; k < 500; ++k){
+					mine.push_back(p.create_node<add_one>());
+					if (k % 2 == 1){
+						p.erase_node(mine[mine.size() - 2]);
+					}
+				}
+			});
+		}
+	}
+	for (auto& mine : ids){
+		for (auto k = 1u; k < mine.size(); k += 2){
+			REQUIRE(p.get_node(mine[k])->name() == "AddOne");
+		}
+	}
+}
+
+TEST_CASE("reconfiguration: a run keeps its plan while the graph is invalid and catches up when it returns"){
+	ppl::pipeline p{};
+	auto stop = std::atomic<bool>{false};
+	auto seen = std::array<std::atomic<int>, 2>{};
+	auto destroyed = std::array<std::atomic<bool>, 2>{};
+	auto src = p.create_node<gated_source>(&stop);
+	auto kept = p.create_node<watched_sink>(&seen[0], &destroyed[0]);
+	auto mid = p.create_node<add_one>();
+	auto erased = p.create_node<watched_sink>(&seen[1], &destroyed[1]);
+	p.connect(src, kept, 0);
+	p.connect(src, mid, 0);
+	p.connect(mid, erased, 0);
+
+	auto runner = std::jthread{[&p] { p.run(); }};
+	while (seen[1].load() == 0){
+		std::this_thread::yield();
+	}
+	// mid is left without a dependent, so the old plan, erased sink included, keeps running
+	p.erase_node(erased);
+	auto before = seen[1].load();
+	while (seen[1].load() == before){
+		std::this_thread::yield();
+	}
+	REQUIRE_FALSE(destroyed[1].load());
+	REQUIRE_FALSE(p.is_valid());
+
+	stop = true;
+	runner.join();
+	REQUIRE(destroyed[1].load());
+	REQUIRE_THROWS_AS(p.get_node(erased), ppl::pipeline_error);
+	// the erased sink's slot is free for reuse once reclaimed
+	auto reused = p.create_node<add_one>();
+	REQUIRE((reused & 0xffffffffu) == (erased & 0xffffffffu));
+	p.erase_node(reused);
+	p.erase_node(mid);
+	REQUIRE(p.is_valid());
+	REQUIRE(p.get_dependencies(src) == std::vector<std::pair<ppl::pipeline::node_id, int>>{{kept, 0}});
+}
@@ -0,0 +1,86 @@
+#ifndef COMP6771_SHARED_VALUE_H
+#define COMP6771_SHARED_VALUE_H
+
+#include <concepts>
+#include <memory>
+#include <utility>
+
+namespace ppl {
+
+	// A reference-counted, immutable value. Copying a shared_value copies the handle, not the value, so a producer
+	// that broadcasts to many dependents can hand each of them one (see producer::shared()) for the price of a
+	// reference count, and every consumer may keep its handle for as long as it likes.
+	// The value is copied on write: mutate() first clones it unless this handle is the only one left.
+	//
+	// Handles may be copied, kept and released concurrently on different threads, like std::shared_ptr; a single
+	// handle is not synchronised. A moved-from handle may only be assigned to or destroyed.
+	template<typename T>
+	class shared_value {
+	 public:
+		using element_type = T;
+
+		shared_value() requires std::default_initializable<T>
+		: value_(std::make_shared<T>()) {}
+
+		explicit shared_value(T value)
+		: value_(std::make_shared<T>(std::move(value))) {}
+
+		template<typename... Args>
+		explicit shared_value(std::in_place_t, Args&&... args)
+		: value_(std::make_shared<T>(std::forward<Args>(args)...)) {}
+
+		[[nodiscard]] auto get() const noexcept -> const T& {
+			return *this->value_;
+		}
+		[[nodiscard]] auto operator*() const noexcept -> const T& {
+			return *this->value_;
+		}
+		[[nodiscard]] auto operator->() const noexcept -> const T* {
+			return this->value_.get();
+		}
+
+		// The number of handles sharing the value, including this one.
+		[[nodiscard]] auto use_count() const noexcept -> long {
+			return this->value_.use_count();
+		}
+		[[nodiscard]] auto unique() const noexcept -> bool {
+			return this->value_.use_count() == 1;
+		}
+
+		// A mutable reference to the value, which first becomes this handle's own copy if it is shared.
+		// The reference is invalidated by copying this handle.
+		[[nodiscard]] auto mutate() -> T& {
+			if (!this->unique()) {
+				this->value_ = std::make_shared<T>(std::as_const(*this->value_));
+			}
+			return *this->value_;
+		}
+
+		// Releases this handle, moving the value out when nothing else shares it and copying it otherwise.
+		[[nodiscard]] auto take() && -> T {
+			auto value = std::move(this->value_);
+			if (value.use_count() == 1) {
+				return std::move(*value);
+			}
+			return *value;
+		}
+
+		// Compares values, cheaply when both handles share one.
+		friend auto operator==(const shared_value& a, const shared_value& b) -> bool
+		requires std::equality_comparable<T>
+		{
+			return a.value_ == b.value_ || *a.value_ == *b.value_;
+		}
+
+	 private:
+		std::shared_ptr<T> value_;
+	};
+
+	template<typename T, typename... Args>
+	[[nodiscard]] auto make_shared_value(Args&&... args) -> shared_value<T> {
+		return shared_value<T>(std::in_place, std::forward<Args>(args)...);
+	}
+
+} // namespace ppl
+
+#endif // COMP6771_SHARED_VALUE_H
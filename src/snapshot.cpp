@@ -0,0 +1,302 @@
+#include "./snapshot.h"
+
+#include <algorithm>
+#include <ostream>
+
+namespace {
+	constexpr auto magic = std::string_view{"PPLS"};
+	constexpr auto version = std::uint32_t{2};
+	// written natively, so a snapshot from a machine of the other byte order is recognised as such
+	constexpr auto byte_order = std::uint32_t{0x01020304};
+
+	void check(bool condition, const char* what) {
+		if (!condition){
+			throw std::runtime_error(std::string{"invalid snapshot: "} + what);
+		}
+	}
+
+	// Reads a count of items that take at least min_size bytes each, so that a damaged count fails here
+	// instead of allocating for it.
+	auto read_count(ppl::snapshot_reader& in, std::size_t min_size) -> std::size_t {
+		auto count = in.read<std::uint64_t>();
+		check(count <= in.size() / min_size, "count exceeds the data");
+		return count;
+	}
+} // namespace
+
+// Layout, every integer stored natively:
+//   "PPLS", u32 version, u32 byte order mark
+//   u64 tag count, then each tag as a length-prefixed string
+//   u64 slot count, then per slot: u32 generation, u8 live, and for live slots
+//     u64 tag index, u64 parameter size and the parameters,
+//     u64 input count and per input slot the u64 ID feeding it (0 when unfilled),
+//     u64 dependent count and per dependent its u64 ID and i32 slot,
+//     u64 component parent, u64 topological order, u64 creation number
+//   u64 free slot count and the u64 free slot indices, in reuse order
+//   u64 unfilled slots, dangling nodes, component count and next order, u8 components dirty, has cycle, order dirty
+//   u64 nodes created
+void ppl::save_snapshot(std::ostream& os, const pipeline& p, const snapshot_registry& registry) {
+	// only the tags in use are written, numbered in order of first use
+	std::vector<std::size_t> entry_of(p.slots_.size(), 0);
+	std::vector<std::size_t> tag_of_entry(registry.entries_.size(), registry.entries_.size());
+	std::vector<std::size_t> used{};
+	for (auto index = 0u; index < p.slots_.size(); ++index){
+		auto* instance = p.slots_[index].instance.get();
+		if (instance == nullptr){
+			continue;
+		}
+		auto found = registry.by_type_.find(typeid(*instance));
+		if (found == registry.by_type_.end()){
+			throw std::runtime_error("save_snapshot: node type of " + instance->name() + " is not registered");
+		}
+		entry_of[index] = found->second;
+		if (tag_of_entry[found->second] == registry.entries_.size()){
+			tag_of_entry[found->second] = used.size();
+			used.push_back(found->second);
+		}
+	}
+
+	auto out = snapshot_writer{};
+	for (auto c : magic){
+		out.write(c);
+	}
+	out.write(version);
+	out.write(byte_order);
+	out.write(static_cast<std::uint64_t>(used.size()));
+	for (auto entry : used){
+		out.write(std::string_view{registry.entries_[entry].tag});
+	}
+
+	auto params = snapshot_writer{};
+	out.write(static_cast<std::uint64_t>(p.slots_.size()));
+	for (auto index = 0u; index < p.slots_.size(); ++index){
+		auto& slot_n = p.slots_[index];
+		out.write(slot_n.generation);
+		out.write(static_cast<std::uint8_t>(slot_n.instance != nullptr));
+		if (slot_n.instance == nullptr){
+			continue;
+		}
+		out.write(static_cast<std::uint64_t>(tag_of_entry[entry_of[index]]));
+		params = snapshot_writer{};
+		registry.entries_[entry_of[index]].save(*slot_n.instance, params);
+		out.write(static_cast<std::uint64_t>(params.bytes().size()));
+		out.append(params.bytes());
+		out.write(static_cast<std::uint64_t>(slot_n.inputs.size()));
+		for (auto id : slot_n.inputs){
+			out.write(id);
+		}
+		out.write(static_cast<std::uint64_t>(slot_n.dependents.size()));
+		for (auto& [id, slot] : slot_n.dependents){
+			out.write(id);
+			out.write(static_cast<std::int32_t>(slot));
+		}
+		out.write(static_cast<std::uint64_t>(slot_n.component_parent));
+		out.write(static_cast<std::uint64_t>(slot_n.topo_order));
+		out.write(slot_n.serial);
+	}
+
+	out.write(static_cast<std::uint64_t>(p.free_slots_.size()));
+	for (auto index : p.free_slots_){
+		out.write(static_cast<std::uint64_t>(index));
+	}
+	out.write(static_cast<std::uint64_t>(p.unfilled_slots_));
+	out.write(static_cast<std::uint64_t>(p.dangling_nodes_));
+	out.write(static_cast<std::uint64_t>(p.component_count_));
+	out.write(static_cast<std::uint64_t>(p.next_order_));
+	out.write(static_cast<std::uint8_t>(p.components_dirty_));
+	out.write(static_cast<std::uint8_t>(p.has_cycle_));
+	out.write(static_cast<std::uint8_t>(p.order_dirty_));
+	out.write(p.created_);
+
+	auto bytes = out.bytes();
+	os.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+auto ppl::load_snapshot(std::span<const std::byte> data,
+                        const snapshot_registry& registry,
+                        std::pmr::memory_resource* resource) -> pipeline {
+	auto in = snapshot_reader{data};
+	auto header = in.take(magic.size());
+	check(std::equal(magic.begin(), magic.end(), header.begin(), [](char c, std::byte b) {
+		      return static_cast<std::byte>(c) == b;
+	      }),
+	      "not a pipeline snapshot");
+	check(in.read<std::uint32_t>() == version, "unsupported version");
+	check(in.read<std::uint32_t>() == byte_order, "written with another byte order");
+
+	auto tags = std::vector<const snapshot_registry::entry*>(read_count(in, sizeof(std::uint64_t)));
+	for (auto& tag : tags){
+		auto name = in.read_string();
+		auto found = registry.by_tag_.find(name);
+		if (found == registry.by_tag_.end()){
+			throw std::runtime_error("load_snapshot: node type " + name + " is not registered");
+		}
+		tag = &registry.entries_[found->second];
+	}
+
+	auto p = pipeline{resource};
+	auto slot_count = read_count(in, sizeof(std::uint32_t) + sizeof(std::uint8_t));
+	p.slots_.reserve(slot_count);
+	for (auto index = 0u; index < slot_count; ++index){
+		auto generation = in.read<std::uint32_t>();
+		if (in.read<std::uint8_t>() == 0){
+			p.slots_.emplace_back(p.resource_).generation = generation;
+			p.closed_.emplace_back(false);
+			continue;
+		}
+
+		auto tag = in.read<std::uint64_t>();
+		check(tag < tags.size(), "tag index out of range");
+		auto params = snapshot_reader{in.take(in.read<std::uint64_t>())};
+		// with no free slots, create_node() appends, so the node lands in this slot
+		tags[tag]->create(p, params);
+		check(params.empty(), "node parameters left unread");
+
+		auto& slot_n = p.slots_[index];
+		slot_n.generation = generation;
+		check(in.read<std::uint64_t>() == slot_n.inputs.size(), "input count does not match the node type");
+		for (auto& id : slot_n.inputs){
+			id = in.read<pipeline::node_id>();
+		}
+		slot_n.dependents.resize(read_count(in, sizeof(pipeline::node_id) + sizeof(std::int32_t)));
+		for (auto& [id, slot] : slot_n.dependents){
+			id = in.read<pipeline::node_id>();
+			slot = in.read<std::int32_t>();
+		}
+		slot_n.component_parent = in.read<std::uint64_t>();
+		slot_n.topo_order = in.read<std::uint64_t>();
+		slot_n.serial = in.read<std::uint64_t>();
+	}
+
+	auto freed = std::vector<bool>(p.slots_.size(), false);
+	p.free_slots_.resize(read_count(in, sizeof(std::uint64_t)));
+	for (auto& index : p.free_slots_){
+		index = in.read<std::uint64_t>();
+		check(index < p.slots_.size() && p.slots_[index].instance == nullptr && !freed[index], "free slot in use");
+		freed[index] = true;
+	}
+	p.unfilled_slots_ = in.read<std::uint64_t>();
+	p.dangling_nodes_ = in.read<std::uint64_t>();
+	p.component_count_ = in.read<std::uint64_t>();
+	p.next_order_ = in.read<std::uint64_t>();
+	p.components_dirty_ = in.read<std::uint8_t>() != 0;
+	p.has_cycle_ = in.read<std::uint8_t>() != 0;
+	p.order_dirty_ = in.read<std::uint8_t>() != 0;
+	p.created_ = in.read<std::uint64_t>();
+	check(in.empty(), "trailing bytes");
+
+	// Nothing read is trusted: the edges and validity state restored as saved are checked to describe a graph the
+	// pipeline could have built, so that a damaged snapshot fails here rather than in run().
+	auto& slots = p.slots_;
+	auto live = [&slots](pipeline::node_id id) {
+		auto index = pipeline::slot_index_unchecked(id);
+		return id != pipeline::no_node && index < slots.size() && slots[index].instance != nullptr
+		       && pipeline::make_id(index, slots[index].generation) == id;
+	};
+
+	// every filled input slot is listed exactly once among the dependents of the node feeding it, and vice versa
+	auto unfilled = std::size_t{0};
+	auto dangling = std::size_t{0};
+	auto edges = std::size_t{0};
+	for (auto& slot_n : slots){
+		if (slot_n.instance == nullptr){
+			continue;
+		}
+		for (auto slot = 0u; slot < slot_n.inputs.size(); ++slot){
+			auto src = slot_n.inputs[slot];
+			if (src == pipeline::no_node){
+				++unfilled;
+				continue;
+			}
+			check(live(src), "input from a node that does not exist");
+			auto& src_n = slots[pipeline::slot_index_unchecked(src)];
+			check(!src_n.is_sink && pipeline::types_match(*src_n.instance, *slot_n.instance, static_cast<int>(slot)),
+			      "input of the wrong type");
+			++edges;
+		}
+		dangling += !slot_n.is_sink && slot_n.dependents.empty();
+	}
+	auto listed = std::size_t{0};
+	for (auto index = 0u; index < slots.size(); ++index){
+		auto& slot_n = slots[index];
+		if (slot_n.instance == nullptr){
+			continue;
+		}
+		auto self = pipeline::make_id(index, slot_n.generation);
+		for (auto d = 0u; d < slot_n.dependents.size(); ++d){
+			auto [dst, slot] = slot_n.dependents[d];
+			check(live(dst), "dependent that does not exist");
+			auto& dst_inputs = slots[pipeline::slot_index_unchecked(dst)].inputs;
+			check(slot >= 0 && static_cast<std::size_t>(slot) < dst_inputs.size()
+			         && dst_inputs[static_cast<std::size_t>(slot)] == self,
+			      "dependent does not match its input");
+			check(std::find(slot_n.dependents.begin(), slot_n.dependents.begin() + d, slot_n.dependents[d])
+			         == slot_n.dependents.begin() + d,
+			      "dependent listed twice");
+			++listed;
+		}
+	}
+	check(listed == edges, "input without a dependent");
+	check(unfilled == p.unfilled_slots_ && dangling == p.dangling_nodes_, "validity counts do not match the graph");
+
+	// the order must be a permutation of distinct positions, topological unless it is marked as not to be trusted
+	check(p.next_order_ <= 2 * slots.size() + 1, "order out of range");
+	auto taken = std::vector<bool>(p.next_order_, false);
+	for (auto& slot_n : slots){
+		if (slot_n.instance == nullptr){
+			continue;
+		}
+		check(slot_n.topo_order < p.next_order_ && !taken[slot_n.topo_order], "order out of range");
+		taken[slot_n.topo_order] = true;
+		// stale parents are harmless while components are to be recounted
+		check(p.components_dirty_
+		         || (slot_n.component_parent < slots.size() && slots[slot_n.component_parent].instance != nullptr),
+		      "component out of range");
+		if (!p.has_cycle_ && !p.order_dirty_){
+			for (auto src : slot_n.inputs){
+				check(src == pipeline::no_node || slots[pipeline::slot_index_unchecked(src)].topo_order < slot_n.topo_order,
+				      "order is not topological");
+			}
+		}
+	}
+
+	// union-find parents must lead to a root without looping
+	auto state = std::vector<std::uint8_t>(slots.size(), 0); // 1: on the current path, 2: reaches a root
+	auto roots = std::size_t{0};
+	for (auto index = 0u; index < slots.size() && !p.components_dirty_; ++index){
+		if (slots[index].instance == nullptr){
+			continue;
+		}
+		auto path = std::vector<std::size_t>{};
+		auto n = std::size_t{index};
+		while (state[n] == 0 && slots[n].component_parent != n){
+			state[n] = 1;
+			path.push_back(n);
+			n = slots[n].component_parent;
+		}
+		check(state[n] != 1, "component parents form a loop");
+		if (state[n] == 0){
+			++roots;
+		}
+		state[n] = 2;
+		for (auto m : path){
+			state[m] = 2;
+		}
+	}
+	check(p.components_dirty_ || roots == p.component_count_, "component count does not match the graph");
+
+	// creation numbers are distinct and no later than the count of nodes created
+	auto serials = std::vector<std::uint64_t>{};
+	serials.reserve(p.node_count_);
+	for (auto& slot_n : slots){
+		if (slot_n.instance != nullptr){
+			check(slot_n.serial != 0 && slot_n.serial <= p.created_, "creation number out of range");
+			serials.push_back(slot_n.serial);
+		}
+	}
+	std::sort(serials.begin(), serials.end());
+	check(std::adjacent_find(serials.begin(), serials.end()) == serials.end(), "creation number used twice");
+
+	p.connect_recorded_inputs();
+	return p;
+}
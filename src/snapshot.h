@@ -0,0 +1,166 @@
+#ifndef COMP6771_SNAPSHOT_H
+#define COMP6771_SNAPSHOT_H
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iosfwd>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./pipeline.h"
+
+namespace ppl {
+
+	// Appends the constructor parameters of one node to a snapshot, see snapshot_registry::add().
+	// Values are stored as their raw bytes, so snapshots are only read back on the architecture that wrote them.
+	class snapshot_writer {
+	 public:
+		template<typename T>
+		    requires std::is_trivially_copyable_v<T>
+		void write(const T& value) {
+			auto bytes = std::as_bytes(std::span{&value, 1});
+			this->bytes_.insert(this->bytes_.end(), bytes.begin(), bytes.end());
+		}
+
+		// Length-prefixed.
+		void write(std::string_view text) {
+			this->write(static_cast<std::uint64_t>(text.size()));
+			this->append(std::as_bytes(std::span{text.data(), text.size()}));
+		}
+
+		// As they are, without a length.
+		void append(std::span<const std::byte> bytes) {
+			this->bytes_.insert(this->bytes_.end(), bytes.begin(), bytes.end());
+		}
+
+		[[nodiscard]] auto bytes() const noexcept -> std::span<const std::byte> {
+			return this->bytes_;
+		}
+
+	 private:
+		std::vector<std::byte> bytes_{};
+	};
+
+	// Reads back what a snapshot_writer wrote, in the same order. Throws std::runtime_error rather than read past
+	// the end of its input.
+	class snapshot_reader {
+	 public:
+		explicit snapshot_reader(std::span<const std::byte> bytes)
+		: bytes_(bytes) {}
+
+		template<typename T>
+		    requires std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>
+		[[nodiscard]] auto read() -> T {
+			auto value = T{};
+			std::memcpy(&value, this->take(sizeof(T)).data(), sizeof(T));
+			return value;
+		}
+
+		[[nodiscard]] auto read_string() -> std::string {
+			auto size = this->read<std::uint64_t>();
+			auto bytes = this->take(size);
+			return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+		}
+
+		// The next size bytes, as stored.
+		[[nodiscard]] auto take(std::size_t size) -> std::span<const std::byte> {
+			if (size > this->bytes_.size()) {
+				throw std::runtime_error("snapshot is truncated");
+			}
+			auto bytes = this->bytes_.first(size);
+			this->bytes_ = this->bytes_.subspan(size);
+			return bytes;
+		}
+
+		[[nodiscard]] auto empty() const noexcept -> bool {
+			return this->bytes_.empty();
+		}
+		[[nodiscard]] auto size() const noexcept -> std::size_t {
+			return this->bytes_.size();
+		}
+
+	 private:
+		std::span<const std::byte> bytes_;
+	};
+
+	// The node types a snapshot may contain, each under a tag that names it in the snapshot.
+	//
+	//     auto registry = ppl::snapshot_registry{};
+	//     registry.add<my_source>(
+	//        "my_source",
+	//        [](const my_source& n, ppl::snapshot_writer& out) { out.write(n.limit); },
+	//        [](ppl::snapshot_reader& in) { return std::tuple{in.read<int>()}; });
+	//
+	// save writes whatever the node needs to be constructed again; load reads it back as a tuple of constructor
+	// arguments for N.
+	class snapshot_registry {
+	 public:
+		template<typename N, typename Save, typename Load>
+		    requires concrete_node<N> && std::invocable<Save&, const N&, snapshot_writer&>
+		             && std::invocable<Load&, snapshot_reader&>
+		void add(std::string tag, Save save, Load load) {
+			if (this->by_tag_.contains(tag) || this->by_type_.contains(typeid(N))) {
+				throw std::invalid_argument("snapshot_registry: " + tag + " is already registered");
+			}
+			auto index = this->entries_.size();
+			this->entries_.push_back(
+			   {tag,
+			    [save = std::move(save)](const node& n, snapshot_writer& out) mutable {
+				    save(static_cast<const N&>(n), out);
+			    },
+			    [load = std::move(load)](pipeline& p, snapshot_reader& in) mutable {
+				    return std::apply(
+				       [&p](auto&&... args) { return p.create_node<N>(std::forward<decltype(args)>(args)...); },
+				       load(in));
+			    }});
+			this->by_tag_.emplace(std::move(tag), index);
+			this->by_type_.emplace(typeid(N), index);
+		}
+
+	 private:
+		struct entry {
+			std::string tag;
+			std::function<void(const node&, snapshot_writer&)> save;
+			std::function<pipeline::node_id(pipeline&, snapshot_reader&)> create;
+		};
+
+		friend void save_snapshot(std::ostream& os, const pipeline& p, const snapshot_registry& registry);
+		friend auto load_snapshot(std::span<const std::byte> data,
+		                          const snapshot_registry& registry,
+		                          std::pmr::memory_resource* resource) -> pipeline;
+
+		std::vector<entry> entries_{};
+		std::unordered_map<std::string, std::size_t> by_tag_{};
+		std::unordered_map<std::type_index, std::size_t> by_type_{};
+	};
+
+	// Writes the whole graph of p to os in a compact binary form: every node's tag and constructor parameters, its
+	// ID, the wiring of its input slots and the pipeline's validity bookkeeping. Run options, statistics and the
+	// state nodes reach by running are not part of a snapshot.
+	// Throws std::runtime_error if a node's type is not in registry.
+	void save_snapshot(std::ostream& os, const pipeline& p, const snapshot_registry& registry);
+
+	// Rebuilds a pipeline from the bytes save_snapshot() wrote, e.g. a memory-mapped file. Nodes are constructed
+	// through registry and keep their IDs and creation numbers; edges are restored as saved, without connect()'s
+	// checks, and so is the validity state, so that is_valid() does not have to traverse the graph again.
+	// Throws std::runtime_error if data is not such a snapshot or names a tag that is not in registry. The restored edges
+	// and validity state are checked to be consistent with each other, which takes one pass over the graph.
+	[[nodiscard]] auto load_snapshot(std::span<const std::byte> data,
+	                                 const snapshot_registry& registry,
+	                                 std::pmr::memory_resource* resource = std::pmr::get_default_resource()) -> pipeline;
+
+} // namespace ppl
+
+#endif // COMP6771_SNAPSHOT_H
@@ -0,0 +1,93 @@
+#ifndef COMP6771_SPSC_QUEUE_H
+#define COMP6771_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ppl::internal {
+
+	// A bounded, lock-free single-producer/single-consumer ring buffer.
+	// Exactly one thread may push() and exactly one (other) thread may front()/pop()/abandon().
+	// Both sides block by waiting on the other side's index, so an idle stage does not spin.
+	template<typename T>
+	class spsc_queue {
+	 public:
+		// capacity is rounded up to a power of two.
+		explicit spsc_queue(std::size_t capacity)
+		: slots_(round_up(capacity))
+		, mask_(slots_.size() - 1) {}
+
+		spsc_queue(const spsc_queue&) = delete;
+		auto operator=(const spsc_queue&) -> spsc_queue& = delete;
+
+		// Producer side. Blocks while the queue is full.
+		// Returns false (dropping value) once the consumer has abandoned the queue.
+		auto push(T value) -> bool {
+			auto tail = this->tail_.load(std::memory_order_relaxed);
+			while (true){
+				if (this->abandoned_.load(std::memory_order_acquire)){
+					return false;
+				}
+				auto head = this->head_.load(std::memory_order_acquire);
+				if (tail - head <= this->mask_){
+					break;
+				}
+				this->head_.wait(head, std::memory_order_acquire);
+			}
+			this->slots_[tail & this->mask_] = std::move(value);
+			this->tail_.store(tail + 1, std::memory_order_release);
+			this->tail_.notify_one();
+			return true;
+		}
+
+		// Producer side.
+		[[nodiscard]] auto abandoned() const noexcept -> bool {
+			return this->abandoned_.load(std::memory_order_acquire);
+		}
+
+		// Consumer side. Blocks until an item is available; the reference stays valid until pop().
+		auto front() -> T& {
+			auto head = this->head_.load(std::memory_order_relaxed);
+			auto tail = this->tail_.load(std::memory_order_acquire);
+			while (tail == head){
+				this->tail_.wait(tail, std::memory_order_acquire);
+				tail = this->tail_.load(std::memory_order_acquire);
+			}
+			return this->slots_[head & this->mask_];
+		}
+
+		// Consumer side. Precondition: front() has returned since the last pop().
+		void pop() {
+			this->head_.store(this->head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			this->head_.notify_one();
+		}
+
+		// Consumer side: the consumer will never read again, so the producer stops blocking and drops its pushes.
+		void abandon() {
+			this->abandoned_.store(true, std::memory_order_release);
+			// moving head_ wakes a producer waiting for space
+			this->head_.store(this->tail_.load(std::memory_order_acquire), std::memory_order_release);
+			this->head_.notify_one();
+		}
+
+	 private:
+		static auto round_up(std::size_t n) -> std::size_t {
+			auto size = std::size_t{1};
+			while (size < n){
+				size <<= 1u;
+			}
+			return size;
+		}
+
+		std::vector<T> slots_;
+		std::size_t mask_;
+		alignas(64) std::atomic<std::size_t> head_{0}; // next slot to read, written by the consumer
+		alignas(64) std::atomic<std::size_t> tail_{0}; // next slot to write, written by the producer
+		alignas(64) std::atomic<bool> abandoned_{false};
+	};
+
+} // namespace ppl::internal
+
+#endif // COMP6771_SPSC_QUEUE_H
@@ -0,0 +1,329 @@
+#ifndef COMP6771_STATIC_PIPELINE_H
+#define COMP6771_STATIC_PIPELINE_H
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "./pipeline.h"
+
+namespace ppl {
+
+	// An edge of a static_pipeline: the output of node Src fills input slot Slot of node Dst,
+	// where nodes are numbered by their position in the static_pipeline's node list.
+	template<std::size_t Src, std::size_t Dst, std::size_t Slot>
+	struct static_edge {
+		static constexpr auto src = Src;
+		static constexpr auto dst = Dst;
+		static constexpr auto slot = Slot;
+	};
+
+	// A node that a static_pipeline can poll without virtual dispatch: poll_next() must be callable on the concrete
+	// type itself, i.e. declared (or inherited) as a public member rather than only through node.
+	template<typename N>
+	concept static_node = concrete_node<N> && !std::is_abstract_v<N> && requires(N& n) {
+		                                                                 { n.N::poll_next() } -> std::same_as<poll>;
+	                                                                 };
+
+	namespace internal {
+		template<typename N>
+		constexpr auto slot_count = std::tuple_size_v<typename N::input_type>;
+
+		template<typename Nodes, typename Edge>
+		consteval auto static_edge_in_range() -> bool {
+			return Edge::src < std::tuple_size_v<Nodes> && Edge::dst < std::tuple_size_v<Nodes>;
+		}
+
+		template<typename Nodes, typename Edge>
+		consteval auto static_edge_slot_exists() -> bool {
+			if constexpr (static_edge_in_range<Nodes, Edge>()) {
+				return Edge::slot < slot_count<std::tuple_element_t<Edge::dst, Nodes>>;
+			}
+			else {
+				return true; // reported by static_edge_in_range
+			}
+		}
+
+		template<typename Nodes, typename Edge>
+		consteval auto static_edge_types_match() -> bool {
+			if constexpr (static_edge_in_range<Nodes, Edge>() && static_edge_slot_exists<Nodes, Edge>()) {
+				using output_type = typename std::tuple_element_t<Edge::src, Nodes>::output_type;
+				using dst_inputs = typename std::tuple_element_t<Edge::dst, Nodes>::input_type;
+				return !std::is_void_v<output_type>
+				       && std::is_same_v<output_type, std::tuple_element_t<Edge::slot, dst_inputs>>;
+			}
+			else {
+				return true; // reported by the checks above
+			}
+		}
+
+		// The shape of a static_pipeline, for the structural checks of pipeline::is_valid() at compile time.
+		template<std::size_t N, std::size_t E>
+		struct static_graph {
+			std::array<std::size_t, N> slots{}; // input slots per node
+			std::array<bool, N> has_output{};
+			std::array<std::size_t, E> src{};
+			std::array<std::size_t, E> dst{};
+			std::array<std::size_t, E> slot{};
+
+			// Every slot is filled by exactly one edge.
+			[[nodiscard]] constexpr auto slots_filled_once() const -> bool {
+				for (auto i = 0u; i < N; ++i) {
+					for (auto s = 0u; s < this->slots[i]; ++s) {
+						auto fills = 0u;
+						for (auto e = 0u; e < E; ++e) {
+							fills += this->dst[e] == i && this->slot[e] == s;
+						}
+						if (fills != 1) {
+							return false;
+						}
+					}
+				}
+				return true;
+			}
+
+			// Every node with an output feeds at least one other node.
+			[[nodiscard]] constexpr auto outputs_used() const -> bool {
+				for (auto i = 0u; i < N; ++i) {
+					auto used = false;
+					for (auto e = 0u; e < E; ++e) {
+						used = used || this->src[e] == i;
+					}
+					if (this->has_output[i] && !used) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			[[nodiscard]] constexpr auto has_source_and_sink() const -> bool {
+				auto sources = false;
+				auto sinks = false;
+				for (auto i = 0u; i < N; ++i) {
+					sources = sources || this->slots[i] == 0;
+					sinks = sinks || !this->has_output[i];
+				}
+				return sources && sinks;
+			}
+
+			[[nodiscard]] constexpr auto connected() const -> bool {
+				auto parent = std::array<std::size_t, N>{};
+				for (auto i = 0u; i < N; ++i) {
+					parent[i] = i;
+				}
+				auto find = [&parent](std::size_t x) {
+					while (parent[x] != x) {
+						x = parent[x];
+					}
+					return x;
+				};
+				auto components = N;
+				for (auto e = 0u; e < E; ++e) {
+					auto a = find(this->src[e]);
+					auto b = find(this->dst[e]);
+					if (a != b) {
+						parent[a] = b;
+						--components;
+					}
+				}
+				return components <= 1;
+			}
+
+			// Kahn's algorithm, lowest index first. Entries past the returned count are unordered (a cycle).
+			[[nodiscard]] constexpr auto topological_order() const -> std::pair<std::array<std::size_t, N>, std::size_t> {
+				auto order = std::array<std::size_t, N>{};
+				auto indegree = std::array<std::size_t, N>{};
+				for (auto e = 0u; e < E; ++e) {
+					++indegree[this->dst[e]];
+				}
+				auto done = std::array<bool, N>{};
+				auto count = std::size_t{0};
+				for (auto found = true; found;) {
+					found = false;
+					for (auto i = 0u; i < N; ++i) {
+						if (!done[i] && indegree[i] == 0) {
+							done[i] = true;
+							order[count++] = i;
+							for (auto e = 0u; e < E; ++e) {
+								indegree[this->dst[e]] -= this->src[e] == i;
+							}
+							found = true;
+							break;
+						}
+					}
+				}
+				return {order, count};
+			}
+		};
+
+		// Each node lives in its own base so it can be constructed in place from a tuple of arguments,
+		// since nodes are neither copied nor moved once their inputs point at them.
+		template<std::size_t I, typename N>
+		struct static_node_holder {
+			N value;
+
+			static_node_holder() = default;
+			template<typename Args>
+			explicit static_node_holder(Args&& args)
+			: value(std::make_from_tuple<N>(std::forward<Args>(args))) {}
+		};
+
+		template<typename Indices, typename... Nodes>
+		struct static_node_storage;
+
+		template<std::size_t... Is, typename... Nodes>
+		struct static_node_storage<std::index_sequence<Is...>, Nodes...> : static_node_holder<Is, Nodes>... {
+			static_node_storage() = default;
+			template<typename... Args>
+			explicit static_node_storage(Args&&... args)
+			: static_node_holder<Is, Nodes>(std::forward<Args>(args))... {}
+		};
+	} // namespace internal
+
+	// A pipeline whose nodes and edges are fixed at compile time, for hot graphs of known shape.
+	// Slot types and the validity conditions of pipeline::is_valid() are checked when the type is instantiated,
+	// and step() is generated as a straight-line sequence of direct (qualified, non-virtual) poll_next() calls in
+	// topological order, with the same tick semantics as pipeline::step().
+	//
+	//     ppl::static_pipeline<std::tuple<my_source, my_filter, my_sink>,
+	//                          ppl::static_edge<0, 1, 0>, ppl::static_edge<1, 2, 0>> p{};
+	//     p.run();
+	//
+	// Nodes are still handed their inputs through connect() once, on construction.
+	template<typename Nodes, typename... Edges>
+	class static_pipeline;
+
+	template<static_node... Nodes, typename... Edges>
+	class static_pipeline<std::tuple<Nodes...>, Edges...> {
+		using node_list = std::tuple<Nodes...>;
+		static constexpr auto node_count = sizeof...(Nodes);
+
+		static_assert(node_count > 0, "a static_pipeline needs at least one node");
+		static_assert((internal::static_edge_in_range<node_list, Edges>() && ...),
+		              "static_edge refers to a node index past the end of the node list");
+		static_assert((internal::static_edge_slot_exists<node_list, Edges>() && ...),
+		              "static_edge binds a non-existent slot (no_such_slot)");
+		static_assert((internal::static_edge_types_match<node_list, Edges>() && ...),
+		              "static_edge output type does not match the slot type (connection_type_mismatch)");
+
+		static constexpr auto graph = internal::static_graph<node_count, sizeof...(Edges)>{
+		   {internal::slot_count<Nodes>...},
+		   {!std::is_void_v<typename Nodes::output_type>...},
+		   {Edges::src...},
+		   {Edges::dst...},
+		   {Edges::slot...},
+		};
+		static_assert(graph.slots_filled_once(), "every input slot must be filled by exactly one static_edge");
+		static_assert(graph.outputs_used(), "every non-sink node must feed at least one other node");
+		static_assert(graph.has_source_and_sink(), "a static_pipeline needs at least one source and one sink");
+		static_assert(graph.connected(), "a static_pipeline must not contain disconnected subpipelines");
+		static_assert(graph.topological_order().second == node_count, "a static_pipeline must not contain cycles");
+
+		static constexpr auto order = graph.topological_order().first;
+
+	 public:
+		template<std::size_t I>
+		using node_type = std::tuple_element_t<I, node_list>;
+
+		// Default-constructs every node.
+		static_pipeline() {
+			(this->connect_edge<Edges>(), ...);
+		}
+
+		// Constructs node i from the elements of the i-th tuple, e.g. std::forward_as_tuple(42).
+		template<typename... Args>
+		requires(sizeof...(Args) == node_count)
+		explicit static_pipeline(Args&&... args)
+		: nodes_(std::forward<Args>(args)...) {
+			(this->connect_edge<Edges>(), ...);
+		}
+
+		// Nodes hold pointers to each other.
+		static_pipeline(const static_pipeline&) = delete;
+		auto operator=(const static_pipeline&) -> static_pipeline& = delete;
+		~static_pipeline() = default;
+
+		template<std::size_t I>
+		[[nodiscard]] auto get() -> node_type<I>& {
+			return static_cast<internal::static_node_holder<I, node_type<I>>&>(this->nodes_).value;
+		}
+
+		template<std::size_t I>
+		[[nodiscard]] auto get() const -> const node_type<I>& {
+			return static_cast<const internal::static_node_holder<I, node_type<I>>&>(this->nodes_).value;
+		}
+
+		// See pipeline::step().
+		auto step() -> bool {
+			this->tick(std::make_index_sequence<node_count>{});
+			return this->sinks_closed(std::make_index_sequence<node_count>{});
+		}
+
+		// See pipeline::run().
+		void run() {
+			while (!this->step()) {
+			}
+		}
+
+	 private:
+		template<typename Edge>
+		void connect_edge() {
+			auto& dst = static_cast<node&>(this->get<Edge::dst>());
+			dst.connect(&this->get<Edge::src>(), static_cast<int>(Edge::slot));
+			// see component::take()
+			constexpr auto consumers = ((Edges::src == Edge::src ? 1 : 0) + ...);
+			dst.set_exclusive_input(static_cast<int>(Edge::slot), consumers == 1);
+		}
+
+		template<std::size_t... K>
+		void tick(std::index_sequence<K...>) {
+			(this->evaluate<order[K]>(), ...);
+		}
+
+		template<std::size_t I>
+		void evaluate() {
+			auto& status = this->status_[I];
+			if (status == poll::closed) {
+				return; // closed is final, for the node and so for everything it feeds
+			}
+
+			// a closed input closes this node, otherwise an empty input skips it
+			auto inputs_status = poll::ready;
+			(this->merge_input<I, Edges>(inputs_status), ...);
+			if (inputs_status != poll::ready) {
+				status = inputs_status;
+				return;
+			}
+			using N = node_type<I>;
+			status = this->get<I>().N::poll_next();
+		}
+
+		template<std::size_t I, typename Edge>
+		void merge_input(poll& inputs_status) const {
+			if constexpr (Edge::dst == I) {
+				auto in = this->status_[Edge::src];
+				if (in == poll::closed || (in == poll::empty && inputs_status == poll::ready)) {
+					inputs_status = in;
+				}
+			}
+		}
+
+		template<std::size_t... Is>
+		[[nodiscard]] auto sinks_closed(std::index_sequence<Is...>) const -> bool {
+			return ((graph.has_output[Is] || this->status_[Is] == poll::closed) && ...);
+		}
+
+		internal::static_node_storage<std::index_sequence_for<Nodes...>, Nodes...> nodes_;
+		std::array<poll, node_count> status_ = [] {
+			auto status = std::array<poll, node_count>{};
+			status.fill(poll::empty);
+			return status;
+		}();
+	};
+
+} // namespace ppl
+
+#endif // COMP6771_STATIC_PIPELINE_H
@@ -0,0 +1,193 @@
+#include "./task_scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	// Binds t to one CPU. Returns false where affinity is not supported.
+	auto pin_to_cpu([[maybe_unused]] std::thread& t, [[maybe_unused]] std::size_t cpu) -> bool {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+} // namespace
+
+ppl::internal::task_scheduler::task_scheduler(std::size_t workers, bool pin) {
+	auto n = workers > 1 ? workers : 1;
+	for (auto i = 0u; i < n; ++i){
+		this->queues_.push_back(std::make_unique<worker_queue>());
+	}
+	auto cpus = std::max(1u, std::thread::hardware_concurrency());
+	this->pin_requested_ = pin;
+	this->pinned_ = pin;
+	this->threads_.reserve(n - 1);
+	for (auto i = 1u; i < n; ++i){
+		this->threads_.emplace_back([this, i] { this->work_loop(i); });
+		if (pin && !pin_to_cpu(this->threads_.back(), i % cpus)){
+			this->pinned_ = false;
+		}
+	}
+}
+
+ppl::internal::task_scheduler::~task_scheduler() {
+	{
+		auto lock = std::lock_guard{this->mutex_};
+		this->stopping_ = true;
+	}
+	this->wake_.notify_all();
+	for (auto& t : this->threads_){
+		t.join();
+	}
+}
+
+void ppl::internal::task_scheduler::run_round(const std::vector<std::size_t>& seeds,
+                                              std::size_t total,
+                                              const task_body& body) {
+	if (total == 0){
+		return;
+	}
+	// deal the seeds out round-robin so that every worker starts with something to do
+	for (auto i = 0u; i < seeds.size(); ++i){
+		auto& q = *this->queues_[i % this->queues_.size()];
+		auto lock = std::lock_guard{q.mutex};
+		q.tasks.push_back(seeds[i]);
+	}
+
+	{
+		auto lock = std::lock_guard{this->mutex_};
+		this->body_ = &body;
+		this->remaining_.store(total, std::memory_order_relaxed);
+		this->error_ = nullptr;
+		this->failed_.store(false, std::memory_order_relaxed);
+		this->busy_ = this->threads_.size();
+		++this->round_;
+	}
+	this->wake_.notify_all();
+
+	this->drain(0);
+
+	auto lock = std::unique_lock{this->mutex_};
+	this->done_.wait(lock, [this] { return this->busy_ == 0; });
+	this->body_ = nullptr;
+	if (this->error_){
+		for (auto& q : this->queues_){
+			q->tasks.clear(); // every worker has stopped, so no lock is needed
+		}
+		std::rethrow_exception(std::exchange(this->error_, nullptr));
+	}
+}
+
+void ppl::internal::task_scheduler::spawn(std::size_t worker, std::size_t task) {
+	auto& q = *this->queues_[worker];
+	{
+		auto lock = std::lock_guard{q.mutex};
+		q.tasks.push_back(task);
+	}
+	// seq_cst, paired with drain(): either a parking worker sees the new count, or this sees it parked
+	this->spawned_.fetch_add(1);
+	if (this->parked_.load() != 0){
+		{
+			auto lock = std::lock_guard{this->park_mutex_};
+		}
+		this->park_.notify_one();
+	}
+}
+
+void ppl::internal::task_scheduler::work_loop(std::size_t worker) {
+	auto seen = std::size_t{0};
+	while (true){
+		{
+			auto lock = std::unique_lock{this->mutex_};
+			this->wake_.wait(lock, [&] { return this->stopping_ || this->round_ != seen; });
+			if (this->stopping_){
+				return;
+			}
+			seen = this->round_;
+		}
+
+		this->drain(worker);
+
+		auto lock = std::lock_guard{this->mutex_};
+		if (--this->busy_ == 0){
+			this->done_.notify_one();
+		}
+	}
+}
+
+// Runs tasks until the round has none left, or until a task has failed
+// (its follow-ups will never be spawned, so the count would never reach zero).
+void ppl::internal::task_scheduler::drain(std::size_t worker) {
+	auto task = std::size_t{0};
+	auto finished = [this] {
+		return this->remaining_.load(std::memory_order_acquire) == 0 || this->failed_.load(std::memory_order_acquire);
+	};
+	while (!finished()){
+		auto spawned = this->spawned_.load();
+		if (!this->pop_or_steal(worker, task)){
+			// the tasks left are running elsewhere: sleep until one of them spawns another, or the round ends
+			this->parked_.fetch_add(1);
+			{
+				auto lock = std::unique_lock{this->park_mutex_};
+				this->park_.wait(lock, [&] { return this->spawned_.load() != spawned || finished(); });
+			}
+			this->parked_.fetch_sub(1);
+			continue;
+		}
+		try {
+			(*this->body_)(task, worker);
+		} catch (...) {
+			{
+				auto lock = std::lock_guard{this->mutex_};
+				if (!this->error_){
+					this->error_ = std::current_exception();
+				}
+				this->failed_.store(true, std::memory_order_release);
+			}
+			this->unpark_all();
+		}
+		if (this->remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1){
+			this->unpark_all();
+		}
+	}
+}
+
+void ppl::internal::task_scheduler::unpark_all() {
+	// taking the lock orders this after any worker's check of the predicate, so none of them misses the wake
+	{
+		auto lock = std::lock_guard{this->park_mutex_};
+	}
+	this->park_.notify_all();
+}
+
+auto ppl::internal::task_scheduler::pop_or_steal(std::size_t worker, std::size_t& task) -> bool {
+	{
+		auto& own = *this->queues_[worker];
+		auto lock = std::lock_guard{own.mutex};
+		if (!own.tasks.empty()){
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	auto n = this->queues_.size();
+	for (auto k = 1u; k < n; ++k){
+		auto& victim = *this->queues_[(worker + k) % n];
+		auto lock = std::lock_guard{victim.mutex};
+		if (!victim.tasks.empty()){
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
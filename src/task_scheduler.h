@@ -0,0 +1,93 @@
+#ifndef COMP6771_TASK_SCHEDULER_H
+#define COMP6771_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ppl::internal {
+
+	// A work-stealing scheduler for rounds of dependent tasks.
+	// Each worker owns a deque: it pushes and pops newly spawned tasks at the back (so a chain keeps running on the
+	// same core while its inputs are still in cache) and, when it runs dry, steals the oldest task from another
+	// worker's front. A round finishes once the announced number of tasks has run.
+	class task_scheduler {
+	 public:
+		// The body of a round: runs task on worker, and may spawn() follow-up tasks onto that worker.
+		using task_body = std::function<void(std::size_t task, std::size_t worker)>;
+
+		// Spawns workers - 1 threads; the thread calling run_round() is worker 0.
+		// With pin, thread k is bound to CPU k modulo the number of CPUs (where the platform supports it). Worker 0
+		// is the caller's own thread, which may differ from round to round, so it is left unpinned; CPU 0 stays free
+		// for it until there are more workers than CPUs.
+		task_scheduler(std::size_t workers, bool pin);
+		task_scheduler(const task_scheduler&) = delete;
+		auto operator=(const task_scheduler&) -> task_scheduler& = delete;
+		~task_scheduler();
+
+		[[nodiscard]] auto size() const noexcept -> std::size_t {
+			return this->queues_.size();
+		}
+		// Whether pinning was asked for, regardless of whether it took.
+		[[nodiscard]] auto pin_requested() const noexcept -> bool {
+			return this->pin_requested_;
+		}
+		// Whether every spawned thread is bound to its CPU.
+		[[nodiscard]] auto pinned() const noexcept -> bool {
+			return this->pinned_;
+		}
+
+		// Runs seeds and everything they spawn, and returns once total tasks have run.
+		// If a task throws, the round still counts down to total (later tasks are skipped as they are claimed)
+		// and the first exception is rethrown here.
+		void run_round(const std::vector<std::size_t>& seeds, std::size_t total, const task_body& body);
+
+		// Only from inside a task body running on worker.
+		void spawn(std::size_t worker, std::size_t task);
+
+	 private:
+		struct alignas(64) worker_queue {
+			std::mutex mutex{};
+			std::deque<std::size_t> tasks{};
+		};
+
+		void work_loop(std::size_t worker);
+		void drain(std::size_t worker);
+		auto pop_or_steal(std::size_t worker, std::size_t& task) -> bool;
+		// Wakes every parked worker, once the round has finished or failed.
+		void unpark_all();
+
+		std::vector<std::unique_ptr<worker_queue>> queues_{};
+		std::vector<std::thread> threads_{};
+		bool pin_requested_ = false;
+		bool pinned_ = false;
+
+		std::mutex mutex_{};
+		std::condition_variable wake_{};
+		std::condition_variable done_{};
+		std::size_t round_ = 0;
+		std::size_t busy_ = 0;
+		bool stopping_ = false;
+
+		const task_body* body_ = nullptr;
+		std::atomic<std::size_t> remaining_{0};
+		std::exception_ptr error_{};
+		std::atomic<bool> failed_{false};
+
+		// Workers that find nothing to run wait here until a task is spawned or the round ends, rather than spin.
+		std::mutex park_mutex_{};
+		std::condition_variable park_{};
+		std::atomic<std::size_t> spawned_{0};
+		std::atomic<std::size_t> parked_{0};
+	};
+
+} // namespace ppl::internal
+
+#endif // COMP6771_TASK_SCHEDULER_H
@@ -0,0 +1,151 @@
+#include "./trace_writer.h"
+
+#include <atomic>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+	// Flush once this much formatted JSON has accumulated.
+	constexpr auto flush_threshold = std::size_t{1} << 20;
+
+	// Appends ns as microseconds with three decimals, the unit trace-event timestamps use.
+	void append_us(std::string& out, std::int64_t ns) {
+		if (ns < 0){
+			ns = 0;
+		}
+		char digits[24];
+		auto whole = std::to_chars(digits, digits + sizeof(digits), ns / 1000).ptr;
+		out.append(digits, whole);
+		auto frac = ns % 1000;
+		out.push_back('.');
+		out.push_back(static_cast<char>('0' + frac / 100));
+		out.push_back(static_cast<char>('0' + frac / 10 % 10));
+		out.push_back(static_cast<char>('0' + frac % 10));
+	}
+
+	void append_uint(std::string& out, std::uint64_t value) {
+		char digits[24];
+		out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+	}
+
+	void append_escaped(std::string& out, std::string_view text) {
+		constexpr auto hex = std::string_view{"0123456789abcdef"};
+		for (auto c : text){
+			if (c == '"' || c == '\\'){
+				out.push_back('\\');
+				out.push_back(c);
+			}
+			else if (static_cast<unsigned char>(c) < 0x20){
+				out.append("\\u00");
+				out.push_back(hex[static_cast<unsigned char>(c) >> 4u]);
+				out.push_back(hex[static_cast<unsigned char>(c) & 0xfu]);
+			}
+			else {
+				out.push_back(c);
+			}
+		}
+	}
+
+	auto poll_name(ppl::poll status) -> std::string_view {
+		switch (status){
+		case ppl::poll::ready: return "ready";
+		case ppl::poll::empty: return "empty";
+		case ppl::poll::closed: return "closed";
+		}
+		return "unknown";
+	}
+} // namespace
+
+auto ppl::internal::trace_thread_id() -> std::uint32_t {
+	static auto next = std::atomic<std::uint32_t>{1};
+	thread_local auto id = next.fetch_add(1, std::memory_order_relaxed);
+	return id;
+}
+
+ppl::internal::trace_writer::trace_writer(const std::string& path)
+: out_(path, std::ios::binary | std::ios::trunc) {
+	if (!this->out_){
+		throw std::runtime_error("cannot open trace file " + path);
+	}
+	this->buffer_.reserve(flush_threshold + flush_threshold / 4);
+	this->buffer_.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+}
+
+ppl::internal::trace_writer::~trace_writer() {
+	this->buffer_.append("\n]}\n");
+	this->flush();
+}
+
+auto ppl::internal::trace_writer::since_start(std::chrono::steady_clock::time_point t) const -> std::int64_t {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t - this->start_).count();
+}
+
+void ppl::internal::trace_writer::tick(std::int64_t start, std::int64_t end) {
+	auto name = std::string{"tick "};
+	append_uint(name, ++this->ticks_);
+	this->span(name, start, end);
+}
+
+void ppl::internal::trace_writer::span(std::string_view name, std::int64_t start, std::int64_t end) {
+	this->begin_event();
+	auto& out = this->buffer_;
+	out.append("{\"name\":\"");
+	append_escaped(out, name);
+	out.append("\",\"cat\":\"tick\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+	append_uint(out, trace_thread_id());
+	out.append(",\"ts\":");
+	append_us(out, start);
+	out.append(",\"dur\":");
+	append_us(out, end - start);
+	out.push_back('}');
+	if (out.size() >= flush_threshold){
+		this->flush();
+	}
+}
+
+void ppl::internal::trace_writer::polls(std::uint64_t serial, const node& n, std::span<const trace_event> events) {
+	auto& label = this->labels_[&n];
+	if (label.first != serial || label.second.empty()){
+		// a node erased since may have left its address to this one
+		label.first = serial;
+		label.second.clear();
+		append_uint(label.second, serial);
+		label.second.push_back(' ');
+		append_escaped(label.second, n.name());
+	}
+
+	auto& out = this->buffer_;
+	for (auto& event : events){
+		this->begin_event();
+		out.append("{\"name\":\"");
+		out.append(label.second);
+		out.append("\",\"cat\":\"poll\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+		append_uint(out, event.thread);
+		out.append(",\"ts\":");
+		append_us(out, event.start);
+		out.append(",\"dur\":");
+		append_us(out, event.end - event.start);
+		out.append(",\"args\":{\"id\":");
+		append_uint(out, serial);
+		out.append(",\"poll\":\"");
+		out.append(poll_name(event.status));
+		out.append("\"}}");
+		if (out.size() >= flush_threshold){
+			this->flush();
+		}
+	}
+}
+
+void ppl::internal::trace_writer::begin_event() {
+	if (!this->first_event_){
+		this->buffer_.push_back(',');
+	}
+	this->buffer_.push_back('\n');
+	this->first_event_ = false;
+}
+
+void ppl::internal::trace_writer::flush() {
+	this->out_.write(this->buffer_.data(), static_cast<std::streamsize>(this->buffer_.size()));
+	this->out_.flush();
+	this->buffer_.clear();
+}
@@ -0,0 +1,56 @@
+#ifndef COMP6771_TRACE_WRITER_H
+#define COMP6771_TRACE_WRITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "./pipeline.h"
+
+namespace ppl::internal {
+
+	// Writes a Chrome trace-event JSON file (viewable in chrome://tracing or Perfetto) for a pipeline.
+	// Events are formatted into an in-memory buffer that is written out in large chunks, so that tracing a long run
+	// costs one write per megabyte rather than one per event. Not thread-safe: the pipeline collects events per node
+	// while polling and hands them over here from a single thread.
+	class trace_writer {
+	 public:
+		// Throws std::runtime_error if path cannot be opened for writing.
+		explicit trace_writer(const std::string& path);
+		trace_writer(const trace_writer&) = delete;
+		auto operator=(const trace_writer&) -> trace_writer& = delete;
+		// Closes the JSON document and writes out whatever is still buffered.
+		~trace_writer();
+
+		// Nanoseconds from the start of the trace to t, the time base of every event.
+		[[nodiscard]] auto since_start(std::chrono::steady_clock::time_point t) const -> std::int64_t;
+
+		// A span on the calling thread covering the next tick, labelled "tick n".
+		void tick(std::int64_t start, std::int64_t end);
+		// A span on the calling thread, e.g. a whole streaming run.
+		void span(std::string_view name, std::int64_t start, std::int64_t end);
+		// Poll slices of node n, labelled "serial name" as in the pipeline's DOT output and with the poll state.
+		// serial is the number the pipeline shows for n, or for the composite n belongs to.
+		void polls(std::uint64_t serial, const node& n, std::span<const trace_event> events);
+
+	 private:
+		void begin_event();
+		void flush();
+
+		std::ofstream out_;
+		std::string buffer_{};
+		bool first_event_ = true;
+		std::uint64_t ticks_ = 0;
+		std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+		// names are looked up once per node, already escaped for JSON; nodes within a composite share its ID
+		std::unordered_map<const node*, std::pair<std::uint64_t, std::string>> labels_{};
+	};
+
+} // namespace ppl::internal
+
+#endif // COMP6771_TRACE_WRITER_H
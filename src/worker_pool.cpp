@@ -0,0 +1,96 @@
+#include "./worker_pool.h"
+
+ppl::internal::worker_pool::worker_pool(std::size_t workers) {
+	auto extra = workers > 1 ? workers - 1 : 0;
+	this->threads_.reserve(extra);
+	for (auto i = 0u; i < extra; ++i){
+		this->threads_.emplace_back([this] { this->work_loop(); });
+	}
+}
+
+ppl::internal::worker_pool::~worker_pool() {
+	{
+		auto lock = std::lock_guard{this->mutex_};
+		this->stopping_ = true;
+	}
+	this->wake_.notify_all();
+	for (auto& t : this->threads_){
+		t.join();
+	}
+}
+
+void ppl::internal::worker_pool::parallel_for(std::size_t n, const std::function<void(std::size_t)>& body) {
+	if (n == 0){
+		return;
+	}
+	if (this->threads_.empty() || n == 1){
+		for (auto i = 0u; i < n; ++i){
+			body(i);
+		}
+		return;
+	}
+
+	{
+		auto lock = std::lock_guard{this->mutex_};
+		this->body_ = &body;
+		this->end_ = n;
+		this->next_.store(0, std::memory_order_relaxed);
+		this->error_ = nullptr;
+		this->failed_.store(false, std::memory_order_relaxed);
+		this->busy_ = this->threads_.size();
+		++this->job_;
+	}
+	this->wake_.notify_all();
+
+	this->drain();
+
+	auto lock = std::unique_lock{this->mutex_};
+	this->done_.wait(lock, [this] { return this->busy_ == 0; });
+	this->body_ = nullptr;
+	if (this->error_){
+		std::rethrow_exception(std::exchange(this->error_, nullptr));
+	}
+}
+
+void ppl::internal::worker_pool::work_loop() {
+	auto seen = std::size_t{0};
+	while (true){
+		{
+			auto lock = std::unique_lock{this->mutex_};
+			this->wake_.wait(lock, [&] { return this->stopping_ || this->job_ != seen; });
+			if (this->stopping_){
+				return;
+			}
+			seen = this->job_;
+		}
+
+		this->drain();
+
+		auto lock = std::lock_guard{this->mutex_};
+		if (--this->busy_ == 0){
+			this->done_.notify_one();
+		}
+	}
+}
+
+// Claims indices of the current job until there are none left.
+void ppl::internal::worker_pool::drain() {
+	while (true){
+		auto i = this->next_.fetch_add(1, std::memory_order_relaxed);
+		if (i >= this->end_){
+			return;
+		}
+		if (this->failed_.load(std::memory_order_relaxed)){
+			continue;
+		}
+		try {
+			(*this->body_)(i);
+		} catch (...) {
+			auto lock = std::lock_guard{this->mutex_};
+			if (!this->error_){
+				this->error_ = std::current_exception();
+			}
+			this->failed_.store(true, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef COMP6771_WORKER_POOL_H
+#define COMP6771_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ppl::internal {
+
+	// A fixed set of threads that repeatedly split an index range between themselves and the caller.
+	// parallel_for() returns once every index has been processed, so consecutive calls act as barriers.
+	class worker_pool {
+	 public:
+		// Spawns workers - 1 threads; the thread calling parallel_for() is the last worker.
+		explicit worker_pool(std::size_t workers);
+		worker_pool(const worker_pool&) = delete;
+		auto operator=(const worker_pool&) -> worker_pool& = delete;
+		~worker_pool();
+
+		[[nodiscard]] auto size() const noexcept -> std::size_t {
+			return this->threads_.size() + 1;
+		}
+
+		// Calls body(i) for every i in [0, n), spread over all workers.
+		// If any call throws, the remaining indices are still claimed but skipped, and the first exception is
+		// rethrown here.
+		void parallel_for(std::size_t n, const std::function<void(std::size_t)>& body);
+
+	 private:
+		void work_loop();
+		void drain();
+
+		std::vector<std::thread> threads_{};
+
+		std::mutex mutex_{};
+		std::condition_variable wake_{};
+		std::condition_variable done_{};
+		std::size_t job_ = 0; // bumped for every parallel_for(), so sleeping workers can tell a new job from a spurious wake
+		std::size_t busy_ = 0; // workers still inside the current job
+		bool stopping_ = false;
+
+		const std::function<void(std::size_t)>* body_ = nullptr;
+		std::size_t end_ = 0;
+		std::atomic<std::size_t> next_{0};
+		std::exception_ptr error_{};
+		std::atomic<bool> failed_{false};
+	};
+
+} // namespace ppl::internal
+
+#endif // COMP6771_WORKER_POOL_H